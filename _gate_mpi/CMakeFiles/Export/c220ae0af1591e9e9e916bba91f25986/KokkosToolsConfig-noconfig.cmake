@@ -0,0 +1,137 @@
+#----------------------------------------------------------------
+# Generated CMake target import file.
+#----------------------------------------------------------------
+
+# Commands may need to know the format version.
+set(CMAKE_IMPORT_FILE_VERSION 1)
+
+# Import target "KokkosTools::kp_kernel_filter" for configuration ""
+set_property(TARGET KokkosTools::kp_kernel_filter APPEND PROPERTY IMPORTED_CONFIGURATIONS NOCONFIG)
+set_target_properties(KokkosTools::kp_kernel_filter PROPERTIES
+  IMPORTED_LOCATION_NOCONFIG "${_IMPORT_PREFIX}/lib/libkp_kernel_filter.so"
+  IMPORTED_SONAME_NOCONFIG "libkp_kernel_filter.so"
+  )
+
+list(APPEND _cmake_import_check_targets KokkosTools::kp_kernel_filter )
+list(APPEND _cmake_import_check_files_for_KokkosTools::kp_kernel_filter "${_IMPORT_PREFIX}/lib/libkp_kernel_filter.so" )
+
+# Import target "KokkosTools::kp_kernel_logger" for configuration ""
+set_property(TARGET KokkosTools::kp_kernel_logger APPEND PROPERTY IMPORTED_CONFIGURATIONS NOCONFIG)
+set_target_properties(KokkosTools::kp_kernel_logger PROPERTIES
+  IMPORTED_LOCATION_NOCONFIG "${_IMPORT_PREFIX}/lib/libkp_kernel_logger.so"
+  IMPORTED_SONAME_NOCONFIG "libkp_kernel_logger.so"
+  )
+
+list(APPEND _cmake_import_check_targets KokkosTools::kp_kernel_logger )
+list(APPEND _cmake_import_check_files_for_KokkosTools::kp_kernel_logger "${_IMPORT_PREFIX}/lib/libkp_kernel_logger.so" )
+
+# Import target "KokkosTools::kp_kernel_shared" for configuration ""
+set_property(TARGET KokkosTools::kp_kernel_shared APPEND PROPERTY IMPORTED_CONFIGURATIONS NOCONFIG)
+set_target_properties(KokkosTools::kp_kernel_shared PROPERTIES
+  IMPORTED_LINK_INTERFACE_LANGUAGES_NOCONFIG "CXX"
+  IMPORTED_LOCATION_NOCONFIG "${_IMPORT_PREFIX}/lib/libkp_kernel_shared.a"
+  )
+
+list(APPEND _cmake_import_check_targets KokkosTools::kp_kernel_shared )
+list(APPEND _cmake_import_check_files_for_KokkosTools::kp_kernel_shared "${_IMPORT_PREFIX}/lib/libkp_kernel_shared.a" )
+
+# Import target "KokkosTools::kp_kernel_timer" for configuration ""
+set_property(TARGET KokkosTools::kp_kernel_timer APPEND PROPERTY IMPORTED_CONFIGURATIONS NOCONFIG)
+set_target_properties(KokkosTools::kp_kernel_timer PROPERTIES
+  IMPORTED_LOCATION_NOCONFIG "${_IMPORT_PREFIX}/lib/libkp_kernel_timer.so"
+  IMPORTED_SONAME_NOCONFIG "libkp_kernel_timer.so"
+  )
+
+list(APPEND _cmake_import_check_targets KokkosTools::kp_kernel_timer )
+list(APPEND _cmake_import_check_files_for_KokkosTools::kp_kernel_timer "${_IMPORT_PREFIX}/lib/libkp_kernel_timer.so" )
+
+# Import target "KokkosTools::kp_reader" for configuration ""
+set_property(TARGET KokkosTools::kp_reader APPEND PROPERTY IMPORTED_CONFIGURATIONS NOCONFIG)
+set_target_properties(KokkosTools::kp_reader PROPERTIES
+  IMPORTED_LOCATION_NOCONFIG "${_IMPORT_PREFIX}/bin/kp_reader"
+  )
+
+list(APPEND _cmake_import_check_targets KokkosTools::kp_reader )
+list(APPEND _cmake_import_check_files_for_KokkosTools::kp_reader "${_IMPORT_PREFIX}/bin/kp_reader" )
+
+# Import target "KokkosTools::kp_json_writer" for configuration ""
+set_property(TARGET KokkosTools::kp_json_writer APPEND PROPERTY IMPORTED_CONFIGURATIONS NOCONFIG)
+set_target_properties(KokkosTools::kp_json_writer PROPERTIES
+  IMPORTED_LOCATION_NOCONFIG "${_IMPORT_PREFIX}/bin/kp_json_writer"
+  )
+
+list(APPEND _cmake_import_check_targets KokkosTools::kp_json_writer )
+list(APPEND _cmake_import_check_files_for_KokkosTools::kp_json_writer "${_IMPORT_PREFIX}/bin/kp_json_writer" )
+
+# Import target "KokkosTools::kp_hwm" for configuration ""
+set_property(TARGET KokkosTools::kp_hwm APPEND PROPERTY IMPORTED_CONFIGURATIONS NOCONFIG)
+set_target_properties(KokkosTools::kp_hwm PROPERTIES
+  IMPORTED_LOCATION_NOCONFIG "${_IMPORT_PREFIX}/lib/libkp_hwm.so"
+  IMPORTED_SONAME_NOCONFIG "libkp_hwm.so"
+  )
+
+list(APPEND _cmake_import_check_targets KokkosTools::kp_hwm )
+list(APPEND _cmake_import_check_files_for_KokkosTools::kp_hwm "${_IMPORT_PREFIX}/lib/libkp_hwm.so" )
+
+# Import target "KokkosTools::kp_hwm_mpi" for configuration ""
+set_property(TARGET KokkosTools::kp_hwm_mpi APPEND PROPERTY IMPORTED_CONFIGURATIONS NOCONFIG)
+set_target_properties(KokkosTools::kp_hwm_mpi PROPERTIES
+  IMPORTED_LOCATION_NOCONFIG "${_IMPORT_PREFIX}/lib/libkp_hwm_mpi.so"
+  IMPORTED_SONAME_NOCONFIG "libkp_hwm_mpi.so"
+  )
+
+list(APPEND _cmake_import_check_targets KokkosTools::kp_hwm_mpi )
+list(APPEND _cmake_import_check_files_for_KokkosTools::kp_hwm_mpi "${_IMPORT_PREFIX}/lib/libkp_hwm_mpi.so" )
+
+# Import target "KokkosTools::kp_memory_events" for configuration ""
+set_property(TARGET KokkosTools::kp_memory_events APPEND PROPERTY IMPORTED_CONFIGURATIONS NOCONFIG)
+set_target_properties(KokkosTools::kp_memory_events PROPERTIES
+  IMPORTED_LOCATION_NOCONFIG "${_IMPORT_PREFIX}/lib/libkp_memory_events.so"
+  IMPORTED_SONAME_NOCONFIG "libkp_memory_events.so"
+  )
+
+list(APPEND _cmake_import_check_targets KokkosTools::kp_memory_events )
+list(APPEND _cmake_import_check_files_for_KokkosTools::kp_memory_events "${_IMPORT_PREFIX}/lib/libkp_memory_events.so" )
+
+# Import target "KokkosTools::kp_memory_usage" for configuration ""
+set_property(TARGET KokkosTools::kp_memory_usage APPEND PROPERTY IMPORTED_CONFIGURATIONS NOCONFIG)
+set_target_properties(KokkosTools::kp_memory_usage PROPERTIES
+  IMPORTED_LOCATION_NOCONFIG "${_IMPORT_PREFIX}/lib/libkp_memory_usage.so"
+  IMPORTED_SONAME_NOCONFIG "libkp_memory_usage.so"
+  )
+
+list(APPEND _cmake_import_check_targets KokkosTools::kp_memory_usage )
+list(APPEND _cmake_import_check_files_for_KokkosTools::kp_memory_usage "${_IMPORT_PREFIX}/lib/libkp_memory_usage.so" )
+
+# Import target "KokkosTools::kp_chrome_tracing" for configuration ""
+set_property(TARGET KokkosTools::kp_chrome_tracing APPEND PROPERTY IMPORTED_CONFIGURATIONS NOCONFIG)
+set_target_properties(KokkosTools::kp_chrome_tracing PROPERTIES
+  IMPORTED_LOCATION_NOCONFIG "${_IMPORT_PREFIX}/lib/libkp_chrome_tracing.so"
+  IMPORTED_SONAME_NOCONFIG "libkp_chrome_tracing.so"
+  )
+
+list(APPEND _cmake_import_check_targets KokkosTools::kp_chrome_tracing )
+list(APPEND _cmake_import_check_files_for_KokkosTools::kp_chrome_tracing "${_IMPORT_PREFIX}/lib/libkp_chrome_tracing.so" )
+
+# Import target "KokkosTools::kp_space_time_stack" for configuration ""
+set_property(TARGET KokkosTools::kp_space_time_stack APPEND PROPERTY IMPORTED_CONFIGURATIONS NOCONFIG)
+set_target_properties(KokkosTools::kp_space_time_stack PROPERTIES
+  IMPORTED_LOCATION_NOCONFIG "${_IMPORT_PREFIX}/lib/libkp_space_time_stack.so"
+  IMPORTED_SONAME_NOCONFIG "libkp_space_time_stack.so"
+  )
+
+list(APPEND _cmake_import_check_targets KokkosTools::kp_space_time_stack )
+list(APPEND _cmake_import_check_files_for_KokkosTools::kp_space_time_stack "${_IMPORT_PREFIX}/lib/libkp_space_time_stack.so" )
+
+# Import target "KokkosTools::kp_perfetto_connector" for configuration ""
+set_property(TARGET KokkosTools::kp_perfetto_connector APPEND PROPERTY IMPORTED_CONFIGURATIONS NOCONFIG)
+set_target_properties(KokkosTools::kp_perfetto_connector PROPERTIES
+  IMPORTED_LOCATION_NOCONFIG "${_IMPORT_PREFIX}/lib/libkp_perfetto_connector.so"
+  IMPORTED_SONAME_NOCONFIG "libkp_perfetto_connector.so"
+  )
+
+list(APPEND _cmake_import_check_targets KokkosTools::kp_perfetto_connector )
+list(APPEND _cmake_import_check_files_for_KokkosTools::kp_perfetto_connector "${_IMPORT_PREFIX}/lib/libkp_perfetto_connector.so" )
+
+# Commands beyond this point should not need to know the version.
+set(CMAKE_IMPORT_FILE_VERSION)
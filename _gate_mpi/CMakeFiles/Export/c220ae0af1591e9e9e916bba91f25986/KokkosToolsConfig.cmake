@@ -0,0 +1,133 @@
+# Generated by CMake
+
+if("${CMAKE_MAJOR_VERSION}.${CMAKE_MINOR_VERSION}" LESS 2.8)
+   message(FATAL_ERROR "CMake >= 2.8.0 required")
+endif()
+if(CMAKE_VERSION VERSION_LESS "2.8.3")
+   message(FATAL_ERROR "CMake >= 2.8.3 required")
+endif()
+cmake_policy(PUSH)
+cmake_policy(VERSION 2.8.3...3.23)
+#----------------------------------------------------------------
+# Generated CMake target import file.
+#----------------------------------------------------------------
+
+# Commands may need to know the format version.
+set(CMAKE_IMPORT_FILE_VERSION 1)
+
+# Protect against multiple inclusion, which would fail when already imported targets are added once more.
+set(_cmake_targets_defined "")
+set(_cmake_targets_not_defined "")
+set(_cmake_expected_targets "")
+foreach(_cmake_expected_target IN ITEMS KokkosTools::kp_kernel_filter KokkosTools::kp_kernel_logger KokkosTools::kp_kernel_shared KokkosTools::kp_kernel_timer KokkosTools::kp_reader KokkosTools::kp_json_writer KokkosTools::kp_hwm KokkosTools::kp_hwm_mpi KokkosTools::kp_memory_events KokkosTools::kp_memory_usage KokkosTools::kp_chrome_tracing KokkosTools::kp_space_time_stack KokkosTools::kp_perfetto_connector)
+  list(APPEND _cmake_expected_targets "${_cmake_expected_target}")
+  if(TARGET "${_cmake_expected_target}")
+    list(APPEND _cmake_targets_defined "${_cmake_expected_target}")
+  else()
+    list(APPEND _cmake_targets_not_defined "${_cmake_expected_target}")
+  endif()
+endforeach()
+unset(_cmake_expected_target)
+if(_cmake_targets_defined STREQUAL _cmake_expected_targets)
+  unset(_cmake_targets_defined)
+  unset(_cmake_targets_not_defined)
+  unset(_cmake_expected_targets)
+  unset(CMAKE_IMPORT_FILE_VERSION)
+  cmake_policy(POP)
+  return()
+endif()
+if(NOT _cmake_targets_defined STREQUAL "")
+  string(REPLACE ";" ", " _cmake_targets_defined_text "${_cmake_targets_defined}")
+  string(REPLACE ";" ", " _cmake_targets_not_defined_text "${_cmake_targets_not_defined}")
+  message(FATAL_ERROR "Some (but not all) targets in this export set were already defined.\nTargets Defined: ${_cmake_targets_defined_text}\nTargets not yet defined: ${_cmake_targets_not_defined_text}\n")
+endif()
+unset(_cmake_targets_defined)
+unset(_cmake_targets_not_defined)
+unset(_cmake_expected_targets)
+
+
+# Compute the installation prefix relative to this file.
+get_filename_component(_IMPORT_PREFIX "${CMAKE_CURRENT_LIST_FILE}" PATH)
+get_filename_component(_IMPORT_PREFIX "${_IMPORT_PREFIX}" PATH)
+get_filename_component(_IMPORT_PREFIX "${_IMPORT_PREFIX}" PATH)
+if(_IMPORT_PREFIX STREQUAL "/")
+  set(_IMPORT_PREFIX "")
+endif()
+
+# Create imported target KokkosTools::kp_kernel_filter
+add_library(KokkosTools::kp_kernel_filter SHARED IMPORTED)
+
+# Create imported target KokkosTools::kp_kernel_logger
+add_library(KokkosTools::kp_kernel_logger SHARED IMPORTED)
+
+# Create imported target KokkosTools::kp_kernel_shared
+add_library(KokkosTools::kp_kernel_shared STATIC IMPORTED)
+
+# Create imported target KokkosTools::kp_kernel_timer
+add_library(KokkosTools::kp_kernel_timer SHARED IMPORTED)
+
+# Create imported target KokkosTools::kp_reader
+add_executable(KokkosTools::kp_reader IMPORTED)
+
+# Create imported target KokkosTools::kp_json_writer
+add_executable(KokkosTools::kp_json_writer IMPORTED)
+
+# Create imported target KokkosTools::kp_hwm
+add_library(KokkosTools::kp_hwm SHARED IMPORTED)
+
+# Create imported target KokkosTools::kp_hwm_mpi
+add_library(KokkosTools::kp_hwm_mpi SHARED IMPORTED)
+
+# Create imported target KokkosTools::kp_memory_events
+add_library(KokkosTools::kp_memory_events SHARED IMPORTED)
+
+# Create imported target KokkosTools::kp_memory_usage
+add_library(KokkosTools::kp_memory_usage SHARED IMPORTED)
+
+# Create imported target KokkosTools::kp_chrome_tracing
+add_library(KokkosTools::kp_chrome_tracing SHARED IMPORTED)
+
+# Create imported target KokkosTools::kp_space_time_stack
+add_library(KokkosTools::kp_space_time_stack SHARED IMPORTED)
+
+# Create imported target KokkosTools::kp_perfetto_connector
+add_library(KokkosTools::kp_perfetto_connector SHARED IMPORTED)
+
+# Load information for each installed configuration.
+file(GLOB _cmake_config_files "${CMAKE_CURRENT_LIST_DIR}/KokkosToolsConfig-*.cmake")
+foreach(_cmake_config_file IN LISTS _cmake_config_files)
+  include("${_cmake_config_file}")
+endforeach()
+unset(_cmake_config_file)
+unset(_cmake_config_files)
+
+# Cleanup temporary variables.
+set(_IMPORT_PREFIX)
+
+# Loop over all imported files and verify that they actually exist
+foreach(_cmake_target IN LISTS _cmake_import_check_targets)
+  foreach(_cmake_file IN LISTS "_cmake_import_check_files_for_${_cmake_target}")
+    if(NOT EXISTS "${_cmake_file}")
+      message(FATAL_ERROR "The imported target \"${_cmake_target}\" references the file
+   \"${_cmake_file}\"
+but this file does not exist.  Possible reasons include:
+* The file was deleted, renamed, or moved to another location.
+* An install or uninstall procedure did not complete successfully.
+* The installation package was faulty and contained
+   \"${CMAKE_CURRENT_LIST_FILE}\"
+but not all the files it references.
+")
+    endif()
+  endforeach()
+  unset(_cmake_file)
+  unset("_cmake_import_check_files_for_${_cmake_target}")
+endforeach()
+unset(_cmake_target)
+unset(_cmake_import_check_targets)
+
+# This file does not depend on other imported targets which have
+# been exported from the same project but in a separate export set.
+
+# Commands beyond this point should not need to know the version.
+set(CMAKE_IMPORT_FILE_VERSION)
+cmake_policy(POP)
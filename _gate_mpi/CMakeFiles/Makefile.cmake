@@ -0,0 +1,101 @@
+# CMAKE generated file: DO NOT EDIT!
+# Generated by "Unix Makefiles" Generator, CMake Version 3.25
+
+# The generator used is:
+set(CMAKE_DEPENDS_GENERATOR "Unix Makefiles")
+
+# The top level Makefile was generated from the following files:
+set(CMAKE_MAKEFILE_DEPENDS
+  "CMakeCache.txt"
+  "/root/repo/CMakeLists.txt"
+  "CMakeFiles/3.25.1/CMakeCXXCompiler.cmake"
+  "CMakeFiles/3.25.1/CMakeSystem.cmake"
+  "/root/repo/benchmarks/CMakeLists.txt"
+  "/root/repo/benchmarks/simple-kernel-timer/CMakeLists.txt"
+  "/root/repo/benchmarks/space-time-stack/CMakeLists.txt"
+  "/root/repo/cmake/configure_tpls.cmake"
+  "/root/repo/cmake/configure_variorum.cmake"
+  "/root/repo/cmake/utils.cmake"
+  "/root/repo/common/kernel-filter/CMakeLists.txt"
+  "/root/repo/common/kokkos-sampler/CMakeLists.txt"
+  "/root/repo/common/kp_config.hpp.in"
+  "/root/repo/debugging/kernel-logger/CMakeLists.txt"
+  "/root/repo/profiling/chrome-tracing/CMakeLists.txt"
+  "/root/repo/profiling/memory-events/CMakeLists.txt"
+  "/root/repo/profiling/memory-hwm-mpi/CMakeLists.txt"
+  "/root/repo/profiling/memory-hwm/CMakeLists.txt"
+  "/root/repo/profiling/memory-usage/CMakeLists.txt"
+  "/root/repo/profiling/perfetto-connector/CMakeLists.txt"
+  "/root/repo/profiling/simple-kernel-timer/CMakeLists.txt"
+  "/root/repo/profiling/space-time-stack/CMakeLists.txt"
+  "/usr/share/cmake-3.25/Modules/CMakeCXXInformation.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeCommonLanguageInclude.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeGenericSystem.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeInitializeConfigs.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeLanguageInformation.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeSystemSpecificInformation.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeSystemSpecificInitialize.cmake"
+  "/usr/share/cmake-3.25/Modules/CheckCXXSourceCompiles.cmake"
+  "/usr/share/cmake-3.25/Modules/CheckIncludeFileCXX.cmake"
+  "/usr/share/cmake-3.25/Modules/CheckLibraryExists.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/CMakeCommonCompilerMacros.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/GNU-CXX.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/GNU.cmake"
+  "/usr/share/cmake-3.25/Modules/FindMPI.cmake"
+  "/usr/share/cmake-3.25/Modules/FindPackageHandleStandardArgs.cmake"
+  "/usr/share/cmake-3.25/Modules/FindPackageMessage.cmake"
+  "/usr/share/cmake-3.25/Modules/FindPkgConfig.cmake"
+  "/usr/share/cmake-3.25/Modules/FindThreads.cmake"
+  "/usr/share/cmake-3.25/Modules/GNUInstallDirs.cmake"
+  "/usr/share/cmake-3.25/Modules/Internal/CheckSourceCompiles.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/Linux-GNU-CXX.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/Linux-GNU.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/Linux.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/UnixPaths.cmake"
+  )
+
+# The corresponding makefile is:
+set(CMAKE_MAKEFILE_OUTPUTS
+  "Makefile"
+  "CMakeFiles/cmake.check_cache"
+  )
+
+# Byproducts of CMake generate step:
+set(CMAKE_MAKEFILE_PRODUCTS
+  "common/kp_config.hpp"
+  "CMakeFiles/CMakeDirectoryInformation.cmake"
+  "common/kernel-filter/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "common/kokkos-sampler/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "debugging/kernel-logger/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "profiling/simple-kernel-timer/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "profiling/memory-hwm/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "profiling/memory-hwm-mpi/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "profiling/memory-events/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "profiling/memory-usage/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "profiling/chrome-tracing/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "profiling/space-time-stack/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "profiling/perfetto-connector/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "benchmarks/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "benchmarks/simple-kernel-timer/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "benchmarks/space-time-stack/CMakeFiles/CMakeDirectoryInformation.cmake"
+  )
+
+# Dependency information for all targets:
+set(CMAKE_DEPEND_INFO_FILES
+  "common/kernel-filter/CMakeFiles/kp_kernel_filter.dir/DependInfo.cmake"
+  "common/kokkos-sampler/CMakeFiles/kp_kokkos_sampler.dir/DependInfo.cmake"
+  "debugging/kernel-logger/CMakeFiles/kp_kernel_logger.dir/DependInfo.cmake"
+  "profiling/simple-kernel-timer/CMakeFiles/kp_kernel_shared.dir/DependInfo.cmake"
+  "profiling/simple-kernel-timer/CMakeFiles/kp_kernel_timer.dir/DependInfo.cmake"
+  "profiling/simple-kernel-timer/CMakeFiles/kp_reader.dir/DependInfo.cmake"
+  "profiling/simple-kernel-timer/CMakeFiles/kp_json_writer.dir/DependInfo.cmake"
+  "profiling/memory-hwm/CMakeFiles/kp_hwm.dir/DependInfo.cmake"
+  "profiling/memory-hwm-mpi/CMakeFiles/kp_hwm_mpi.dir/DependInfo.cmake"
+  "profiling/memory-events/CMakeFiles/kp_memory_events.dir/DependInfo.cmake"
+  "profiling/memory-usage/CMakeFiles/kp_memory_usage.dir/DependInfo.cmake"
+  "profiling/chrome-tracing/CMakeFiles/kp_chrome_tracing.dir/DependInfo.cmake"
+  "profiling/space-time-stack/CMakeFiles/kp_space_time_stack.dir/DependInfo.cmake"
+  "profiling/perfetto-connector/CMakeFiles/kp_perfetto_connector.dir/DependInfo.cmake"
+  "benchmarks/simple-kernel-timer/CMakeFiles/bench_kernel_lookup.dir/DependInfo.cmake"
+  "benchmarks/space-time-stack/CMakeFiles/bench_stack_events.dir/DependInfo.cmake"
+  )
@@ -0,0 +1,20 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/benchmarks/simple-kernel-timer/bench_kernel_lookup.cpp" "benchmarks/simple-kernel-timer/CMakeFiles/bench_kernel_lookup.dir/bench_kernel_lookup.cpp.o" "gcc" "benchmarks/simple-kernel-timer/CMakeFiles/bench_kernel_lookup.dir/bench_kernel_lookup.cpp.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  "/root/repo/_gate_mpi/profiling/simple-kernel-timer/CMakeFiles/kp_kernel_timer.dir/DependInfo.cmake"
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
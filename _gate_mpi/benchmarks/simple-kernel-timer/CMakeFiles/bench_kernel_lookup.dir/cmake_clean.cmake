@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/bench_kernel_lookup.dir/bench_kernel_lookup.cpp.o"
+  "CMakeFiles/bench_kernel_lookup.dir/bench_kernel_lookup.cpp.o.d"
+  "bench_kernel_lookup"
+  "bench_kernel_lookup.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/bench_kernel_lookup.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
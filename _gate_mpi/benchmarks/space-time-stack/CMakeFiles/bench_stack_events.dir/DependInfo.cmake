@@ -0,0 +1,20 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/benchmarks/space-time-stack/bench_stack_events.cpp" "benchmarks/space-time-stack/CMakeFiles/bench_stack_events.dir/bench_stack_events.cpp.o" "gcc" "benchmarks/space-time-stack/CMakeFiles/bench_stack_events.dir/bench_stack_events.cpp.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  "/root/repo/_gate_mpi/profiling/space-time-stack/CMakeFiles/kp_space_time_stack.dir/DependInfo.cmake"
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
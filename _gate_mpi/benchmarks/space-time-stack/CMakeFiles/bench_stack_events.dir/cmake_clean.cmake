@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/bench_stack_events.dir/bench_stack_events.cpp.o"
+  "CMakeFiles/bench_stack_events.dir/bench_stack_events.cpp.o.d"
+  "bench_stack_events"
+  "bench_stack_events.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/bench_stack_events.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/kp_kernel_filter.dir/kp_kernel_filter.cpp.o"
+  "CMakeFiles/kp_kernel_filter.dir/kp_kernel_filter.cpp.o.d"
+  "libkp_kernel_filter.pdb"
+  "libkp_kernel_filter.so"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/kp_kernel_filter.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/kp_kokkos_sampler.dir/kp_sampler_skip.cpp.o"
+  "CMakeFiles/kp_kokkos_sampler.dir/kp_sampler_skip.cpp.o.d"
+  "libkp_kokkos_sampler.pdb"
+  "libkp_kokkos_sampler.so"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/kp_kokkos_sampler.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,10 @@
+// Note: keep legacy 0|1 or update `#if USE_MPI` checks
+
+#define USE_MPI 1
+
+/* #undef KOKKOSTOOLS_HAS_NVTX */
+/* #undef KOKKOSTOOLS_HAS_ROCTX */
+/* #undef KOKKOSTOOLS_HAS_CALIPER */
+/* #undef KOKKOSTOOLS_HAS_SYSTEMTAP */
+/* #undef KOKKOSTOOLS_HAS_VARIORUM */
+/* #undef KOKKOSTOOLS_HAS_VTUNE */
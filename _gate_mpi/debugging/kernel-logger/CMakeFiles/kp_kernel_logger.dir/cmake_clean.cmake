@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/kp_kernel_logger.dir/kp_kernel_logger.cpp.o"
+  "CMakeFiles/kp_kernel_logger.dir/kp_kernel_logger.cpp.o.d"
+  "libkp_kernel_logger.pdb"
+  "libkp_kernel_logger.so"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/kp_kernel_logger.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
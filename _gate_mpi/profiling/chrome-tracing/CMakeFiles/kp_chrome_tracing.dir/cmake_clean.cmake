@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/kp_chrome_tracing.dir/kp_chrome_tracing.cpp.o"
+  "CMakeFiles/kp_chrome_tracing.dir/kp_chrome_tracing.cpp.o.d"
+  "libkp_chrome_tracing.pdb"
+  "libkp_chrome_tracing.so"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/kp_chrome_tracing.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/kp_memory_events.dir/kp_memory_events.cpp.o"
+  "CMakeFiles/kp_memory_events.dir/kp_memory_events.cpp.o.d"
+  "libkp_memory_events.pdb"
+  "libkp_memory_events.so"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/kp_memory_events.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
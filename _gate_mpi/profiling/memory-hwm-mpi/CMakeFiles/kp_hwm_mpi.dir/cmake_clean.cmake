@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/kp_hwm_mpi.dir/kp_hwm_mpi.cpp.o"
+  "CMakeFiles/kp_hwm_mpi.dir/kp_hwm_mpi.cpp.o.d"
+  "libkp_hwm_mpi.pdb"
+  "libkp_hwm_mpi.so"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/kp_hwm_mpi.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/kp_hwm.dir/kp_hwm.cpp.o"
+  "CMakeFiles/kp_hwm.dir/kp_hwm.cpp.o.d"
+  "libkp_hwm.pdb"
+  "libkp_hwm.so"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/kp_hwm.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
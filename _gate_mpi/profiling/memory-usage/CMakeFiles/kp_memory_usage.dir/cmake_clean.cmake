@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/kp_memory_usage.dir/kp_memory_usage.cpp.o"
+  "CMakeFiles/kp_memory_usage.dir/kp_memory_usage.cpp.o.d"
+  "libkp_memory_usage.pdb"
+  "libkp_memory_usage.so"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/kp_memory_usage.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
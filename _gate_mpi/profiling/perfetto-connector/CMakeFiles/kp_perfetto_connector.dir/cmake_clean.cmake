@@ -0,0 +1,13 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/kp_perfetto_connector.dir/libperfetto-connector.cpp.o"
+  "CMakeFiles/kp_perfetto_connector.dir/libperfetto-connector.cpp.o.d"
+  "CMakeFiles/kp_perfetto_connector.dir/perfetto/perfetto.cc.o"
+  "CMakeFiles/kp_perfetto_connector.dir/perfetto/perfetto.cc.o.d"
+  "libkp_perfetto_connector.pdb"
+  "libkp_perfetto_connector.so"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/kp_perfetto_connector.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/kp_json_writer.dir/kp_json_writer.cpp.o"
+  "CMakeFiles/kp_json_writer.dir/kp_json_writer.cpp.o.d"
+  "kp_json_writer"
+  "kp_json_writer.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/kp_json_writer.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/kp_kernel_shared.dir/kp_shared.cpp.o"
+  "CMakeFiles/kp_kernel_shared.dir/kp_shared.cpp.o.d"
+  "libkp_kernel_shared.a"
+  "libkp_kernel_shared.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/kp_kernel_shared.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,3 @@
+file(REMOVE_RECURSE
+  "libkp_kernel_shared.a"
+)
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/kp_kernel_timer.dir/kp_kernel_timer.cpp.o"
+  "CMakeFiles/kp_kernel_timer.dir/kp_kernel_timer.cpp.o.d"
+  "libkp_kernel_timer.pdb"
+  "libkp_kernel_timer.so"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/kp_kernel_timer.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/kp_reader.dir/kp_reader.cpp.o"
+  "CMakeFiles/kp_reader.dir/kp_reader.cpp.o.d"
+  "kp_reader"
+  "kp_reader.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/kp_reader.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/kp_space_time_stack.dir/kp_space_time_stack.cpp.o"
+  "CMakeFiles/kp_space_time_stack.dir/kp_space_time_stack.cpp.o.d"
+  "libkp_space_time_stack.pdb"
+  "libkp_space_time_stack.so"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/kp_space_time_stack.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
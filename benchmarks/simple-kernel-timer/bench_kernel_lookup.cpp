@@ -0,0 +1,134 @@
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 4.0
+//       Copyright (2022) National Technology & Engineering
+//               Solutions of Sandia, LLC (NTESS).
+//
+// Under the terms of Contract DE-NA0003525 with NTESS,
+// the U.S. Government retains certain rights in this software.
+//
+// Part of Kokkos, under the Apache License v2.0 with LLVM Exceptions.
+// See https://kokkos.org/LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//@HEADER
+
+// Measures the cost of a begin/end kernel pair in the simple kernel timer.
+//
+// "legacy" replays the std::map<std::string, ...> lookup the tool used to do
+// on every launch; "tool" calls the callbacks exported by kp_kernel_timer.
+// Two label patterns are measured: labels with a stable address, and labels
+// copied into one reused buffer, which is what Kokkos does for functors
+// without an explicit name.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include <sys/time.h>
+
+extern "C" {
+void kokkosp_init_library(const int, const uint64_t, const uint32_t, void*);
+void kokkosp_begin_parallel_for(const char*, const uint32_t, uint64_t*);
+void kokkosp_end_parallel_for(const uint64_t);
+}
+
+namespace {
+
+struct LegacyInfo {
+  uint64_t callCount = 0;
+  double time        = 0;
+  double timeSq      = 0;
+  double startTime   = 0;
+};
+
+double legacy_seconds() {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return (double)(now.tv_sec + (now.tv_usec * 1.0e-6));
+}
+
+std::map<std::string, LegacyInfo*> legacy_map;
+LegacyInfo* legacy_current = nullptr;
+
+void legacy_begin(const char* name) {
+  std::string nameStr(name);
+  if (legacy_map.find(name) == legacy_map.end()) {
+    legacy_current = new LegacyInfo();
+    legacy_map.insert(std::make_pair(nameStr, legacy_current));
+  } else {
+    legacy_current = legacy_map[nameStr];
+  }
+  legacy_current->startTime = legacy_seconds();
+}
+
+void legacy_end() {
+  const double t = legacy_seconds() - legacy_current->startTime;
+  legacy_current->time += t;
+  legacy_current->timeSq += t * t;
+  legacy_current->callCount++;
+}
+
+// Launches an empty kernel through the tool: a begin and an end callback.
+void tool_launch(const char* name) {
+  uint64_t kID;
+  kokkosp_begin_parallel_for(name, 0, &kID);
+  kokkosp_end_parallel_for(kID);
+}
+
+template <typename Body>
+double ns_per_pair(size_t iterations, Body&& body) {
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations; ++i) body(i);
+  auto stop = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(stop - start).count() /
+         iterations;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const size_t iterations = argc > 1 ? strtoull(argv[1], nullptr, 10) : 2000000;
+  const size_t nlabels    = argc > 2 ? strtoull(argv[2], nullptr, 10) : 256;
+
+  std::vector<std::string> labels;
+  for (size_t i = 0; i < nlabels; ++i) {
+    labels.push_back("Kokkos::View::initialization [benchmark_view_" +
+                     std::to_string(i) + "] via memset");
+  }
+  char recycled[256];
+
+  kokkosp_init_library(0, 0, 0, nullptr);
+
+  const double legacy_stable = ns_per_pair(iterations, [&](size_t i) {
+    legacy_begin(labels[i % nlabels].c_str());
+    legacy_end();
+  });
+  const double legacy_recycled = ns_per_pair(iterations, [&](size_t i) {
+    strcpy(recycled, labels[i % nlabels].c_str());
+    legacy_begin(recycled);
+    legacy_end();
+  });
+  const double tool_stable = ns_per_pair(iterations, [&](size_t i) {
+    tool_launch(labels[i % nlabels].c_str());
+  });
+  const double tool_recycled = ns_per_pair(iterations, [&](size_t i) {
+    strcpy(recycled, labels[i % nlabels].c_str());
+    tool_launch(recycled);
+  });
+
+  printf("KokkosP: %zu begin/end pairs over %zu labels\n", iterations,
+         nlabels);
+  printf("KokkosP: %-24s %12s %12s\n", "", "stable", "recycled");
+  printf("KokkosP: %-24s %9.1f ns %9.1f ns\n", "legacy std::map lookup",
+         legacy_stable, legacy_recycled);
+  printf("KokkosP: %-24s %9.1f ns %9.1f ns\n", "kernel-timer callbacks",
+         tool_stable, tool_recycled);
+
+  return 0;
+}
@@ -0,0 +1,122 @@
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 4.0
+//       Copyright (2022) National Technology & Engineering
+//               Solutions of Sandia, LLC (NTESS).
+//
+// Under the terms of Contract DE-NA0003525 with NTESS,
+// the U.S. Government retains certain rights in this software.
+//
+// Part of Kokkos, under the Apache License v2.0 with LLVM Exceptions.
+// See https://kokkos.org/LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//@HEADER
+
+// Measures the cost of a begin/end kernel pair in the space-time-stack tool.
+//
+// "legacy" replays what the tool used to do on every launch: demangle the
+// label, then search a std::set of child nodes with a freshly built candidate
+// node. "tool" calls the callbacks exported by kp_space_time_stack. Labels are
+// mangled type names, as Kokkos uses for functors without an explicit name,
+// either at a stable address or copied into one reused buffer.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "utils/demangle.hpp"
+
+extern "C" {
+void kokkosp_init_library(const int, const uint64_t, const uint32_t, void*);
+void kokkosp_begin_parallel_for(const char*, const uint32_t, uint64_t*);
+void kokkosp_end_parallel_for(const uint64_t);
+}
+
+namespace {
+
+struct LegacyNode {
+  std::string name;
+  int kind;
+  std::set<LegacyNode> children;
+  int64_t number_of_calls = 0;
+  LegacyNode(std::string&& name_in, int kind_in)
+      : name(std::move(name_in)), kind(kind_in) {}
+  LegacyNode* get_child(std::string&& child_name, int child_kind) {
+    LegacyNode candidate(std::move(child_name), child_kind);
+    auto it = children.find(candidate);
+    if (it == children.end()) it = children.emplace(std::move(candidate)).first;
+    return const_cast<LegacyNode*>(&(*it));
+  }
+  bool operator<(LegacyNode const& other) const {
+    if (kind != other.kind) return kind < other.kind;
+    return name < other.name;
+  }
+};
+
+LegacyNode legacy_root("", 0);
+
+void legacy_pair(const char* name) {
+  auto node = legacy_root.get_child(KokkosTools::demangleNameKokkos(name), 0);
+  node->number_of_calls++;
+}
+
+void tool_pair(const char* name) {
+  uint64_t kID;
+  kokkosp_begin_parallel_for(name, 0, &kID);
+  kokkosp_end_parallel_for(kID);
+}
+
+template <typename Body>
+double ns_per_pair(size_t iterations, Body&& body) {
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations; ++i) body(i);
+  auto stop = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(stop - start).count() /
+         iterations;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const size_t iterations = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1000000;
+  const size_t nlabels    = argc > 2 ? strtoull(argv[2], nullptr, 10) : 256;
+
+  std::vector<std::string> labels;
+  for (size_t i = 0; i < nlabels; ++i) {
+    labels.push_back("N9benchmark13StencilFunctorINS_4TagILi" +
+                     std::to_string(i) + "EEEdEE");
+  }
+  char recycled[256];
+
+  kokkosp_init_library(0, 0, 0, nullptr);
+
+  const double legacy_stable = ns_per_pair(
+      iterations, [&](size_t i) { legacy_pair(labels[i % nlabels].c_str()); });
+  const double legacy_recycled = ns_per_pair(iterations, [&](size_t i) {
+    strcpy(recycled, labels[i % nlabels].c_str());
+    legacy_pair(recycled);
+  });
+  const double tool_stable = ns_per_pair(
+      iterations, [&](size_t i) { tool_pair(labels[i % nlabels].c_str()); });
+  const double tool_recycled = ns_per_pair(iterations, [&](size_t i) {
+    strcpy(recycled, labels[i % nlabels].c_str());
+    tool_pair(recycled);
+  });
+
+  printf("KokkosP: %zu begin/end pairs over %zu labels\n", iterations,
+         nlabels);
+  printf("KokkosP: %-26s %12s %12s\n", "", "stable", "recycled");
+  printf("KokkosP: %-26s %9.1f ns %9.1f ns\n", "legacy demangle + std::set",
+         legacy_stable, legacy_recycled);
+  printf("KokkosP: %-26s %9.1f ns %9.1f ns\n", "space-time-stack callbacks",
+         tool_stable, tool_recycled);
+
+  return 0;
+}
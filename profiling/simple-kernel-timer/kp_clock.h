@@ -0,0 +1,123 @@
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 4.0
+//       Copyright (2022) National Technology & Engineering
+//               Solutions of Sandia, LLC (NTESS).
+//
+// Under the terms of Contract DE-NA0003525 with NTESS,
+// the U.S. Government retains certain rights in this software.
+//
+// Part of Kokkos, under the Apache License v2.0 with LLVM Exceptions.
+// See https://kokkos.org/LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//@HEADER
+
+#ifndef _H_KOKKOSP_CLOCK
+#define _H_KOKKOSP_CLOCK
+
+#include <stdio.h>
+#include <cstdint>
+#include <cstring>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define KOKKOSP_HAS_TSC
+#endif
+
+namespace KokkosTools::KernelTimer {
+
+/**
+ * Clock sources for kernel timings. Timings are kept as integer ticks of the
+ * selected source and only converted to seconds on output.
+ *
+ * - MONOTONIC_RAW: clock_gettime(CLOCK_MONOTONIC_RAW), one tick per ns. It is
+ *   not slewed by NTP, so durations can't go negative. Default.
+ * - TSC: the time-stamp counter, calibrated against MONOTONIC_RAW at
+ *   initialization. Only offered if the CPU reports an invariant TSC.
+ */
+enum ClockSource { CLOCK_SOURCE_MONOTONIC_RAW = 0, CLOCK_SOURCE_TSC = 1 };
+
+inline ClockSource clockSource = CLOCK_SOURCE_MONOTONIC_RAW;
+inline double secondsPerTick   = 1.0e-9;
+
+inline uint64_t monotonicRawTicks() {
+  struct timespec now;
+#if defined(CLOCK_MONOTONIC_RAW)
+  clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+#else
+  clock_gettime(CLOCK_MONOTONIC, &now);
+#endif
+  return uint64_t(now.tv_sec) * 1000000000ULL + uint64_t(now.tv_nsec);
+}
+
+inline uint64_t ticks() {
+#if defined(KOKKOSP_HAS_TSC)
+  if (clockSource == CLOCK_SOURCE_TSC) return __rdtsc();
+#endif
+  return monotonicRawTicks();
+}
+
+inline double ticksToSeconds(const uint64_t t) { return t * secondsPerTick; }
+
+inline uint64_t ticksToNanoseconds(const uint64_t t) {
+  return uint64_t(t * (secondsPerTick * 1.0e9));
+}
+
+inline uint64_t nanosecondsToTicks(const uint64_t ns) {
+  return uint64_t(ns * (1.0e-9 / secondsPerTick) + 0.5);
+}
+
+inline uint64_t secondsToTicks(const double s) {
+  return s <= 0 ? 0 : uint64_t(s / secondsPerTick + 0.5);
+}
+
+inline const char* clockSourceName(const ClockSource source) {
+  return source == CLOCK_SOURCE_TSC ? "tsc" : "monotonic-raw";
+}
+
+/// Select the clock source named @p name ("tsc" or "monotonic"), falling
+/// back to MONOTONIC_RAW if the TSC is not usable. Must be called before any
+/// timing is taken.
+inline ClockSource selectClockSource(const char* name) {
+  clockSource    = CLOCK_SOURCE_MONOTONIC_RAW;
+  secondsPerTick = 1.0e-9;
+
+  if (name == nullptr || strcmp(name, "tsc") != 0) return clockSource;
+
+#if defined(KOKKOSP_HAS_TSC)
+  unsigned int eax, ebx, ecx, edx;
+  const bool invariant = __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) &&
+                         (edx & (1u << 8)) != 0;
+  if (!invariant) {
+    fprintf(stderr,
+            "KokkosP: WARNING: TSC is not invariant on this CPU, falling back "
+            "to %s\n",
+            clockSourceName(clockSource));
+    return clockSource;
+  }
+
+  // Calibrate over ~20ms, which keeps the error well below 0.1%.
+  const uint64_t wallStart = monotonicRawTicks();
+  const uint64_t tscStart  = __rdtsc();
+  uint64_t wallEnd         = wallStart;
+  while (wallEnd - wallStart < 20000000ULL) wallEnd = monotonicRawTicks();
+  const uint64_t tscEnd = __rdtsc();
+
+  if (tscEnd > tscStart) {
+    clockSource    = CLOCK_SOURCE_TSC;
+    secondsPerTick = (wallEnd - wallStart) * 1.0e-9 / (tscEnd - tscStart);
+  }
+#else
+  fprintf(stderr, "KokkosP: WARNING: no TSC on this platform, falling back "
+                  "to monotonic-raw\n");
+#endif
+  return clockSource;
+}
+
+}  // namespace KokkosTools::KernelTimer
+
+#endif  // _H_KOKKOSP_CLOCK
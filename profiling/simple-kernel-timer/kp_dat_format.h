@@ -0,0 +1,593 @@
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 4.0
+//       Copyright (2022) National Technology & Engineering
+//               Solutions of Sandia, LLC (NTESS).
+//
+// Under the terms of Contract DE-NA0003525 with NTESS,
+// the U.S. Government retains certain rights in this software.
+//
+// Part of Kokkos, under the Apache License v2.0 with LLVM Exceptions.
+// See https://kokkos.org/LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//@HEADER
+
+#ifndef _H_KOKKOSP_DAT_FORMAT
+#define _H_KOKKOSP_DAT_FORMAT
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "kp_kernel_info.h"
+
+namespace KokkosTools::KernelTimer {
+
+/**
+ * Version 2 of the kernel timer .dat format.
+ *
+ *   DatFileHeader                      (headerSize bytes)
+ *   DatRecord[recordCount]             (recordSize bytes each, 8-byte aligned)
+ *   DatBucket[bucketCount]             (histogram buckets of all records)
+ *   DatDevice[deviceCount]             (kernel totals per device)
+ *   string table                       (NUL-terminated, deduplicated names)
+ *
+ * Everything is written in the byte order of the writer, which readers check
+ * with the endianness marker. Durations are integer nanoseconds. The header
+ * and record sizes are stored so that fields can be appended later: readers
+ * zero-fill fields a file does not have and ignore fields they don't know.
+ *
+ * Files merged from several MPI ranks, see kp_mpi_reduce.h, also carry the
+ * spread of each kernel's per-rank total time in their records.
+ *
+ * Version 1 files have no header; they start with the total execution time
+ * as a double followed by length-prefixed records, see
+ * KernelPerformanceInfo::writeToBinaryFile.
+ */
+constexpr char datMagic[8]         = {'K', 'P', 'K', 'T', 'D', 'A', 'T', '\0'};
+constexpr uint32_t datVersion      = 2;
+constexpr uint32_t datEndianMarker = 0x01020304;
+
+struct DatFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t endianMarker;
+  uint32_t headerSize;
+  uint32_t recordSize;
+  uint64_t recordCount;
+  uint64_t recordsOffset;
+  uint64_t bucketCount;
+  uint64_t bucketsOffset;
+  uint64_t stringsSize;
+  uint64_t stringsOffset;
+  double totalExecuteTime;
+  uint32_t histogramLayout;
+  uint32_t reserved;
+  uint64_t deviceCount;
+  uint64_t devicesOffset;
+  uint64_t rankCount;  // ranks merged into the file, 0 for a single process
+};
+
+struct DatRecord {
+  uint64_t callCount;
+  uint64_t timeNs;
+  double timeSq;  // sum of squared call durations in s^2
+  uint64_t minNs;
+  uint64_t maxNs;
+  uint64_t firstBucket;
+  uint32_t bucketCount;
+  uint32_t kernelType;
+  uint32_t nameOffset;
+  uint32_t nameLength;
+  uint32_t deviceID;  // devID of the launches, 0 for regions
+  uint32_t reserved;
+  uint64_t selfNs;  // exclusive time of regions, 0 for kernels
+  // Spread of the per-rank totals; rankCount is 0 unless ranks were merged.
+  uint64_t rankCount;  // ranks that ran the kernel
+  uint64_t rankMinNs;
+  uint64_t rankMaxNs;
+  double rankSumSq;  // sum of the squared per-rank totals in s^2
+  uint64_t rankMax;  // rank with the largest total
+};
+
+struct DatBucket {
+  uint32_t index;
+  uint32_t reserved;
+  uint64_t count;
+};
+
+/// Time spent in kernels on a device, over all its instances. The device
+/// utilization is timeNs over the total execution time.
+struct DatDevice {
+  uint32_t device;
+  uint32_t reserved;
+  uint64_t callCount;
+  uint64_t timeNs;
+};
+
+static_assert(sizeof(DatFileHeader) % 8 == 0 && sizeof(DatRecord) % 8 == 0 &&
+                  sizeof(DatBucket) % 8 == 0 && sizeof(DatDevice) % 8 == 0,
+              "v2 sections must stay 8-byte aligned");
+
+inline uint64_t secondsToNanoseconds(const double s) {
+  return s <= 0 ? 0 : uint64_t(std::llround(s * 1.0e9));
+}
+
+/**
+ * @brief Spread of the total time of a kernel across input files.
+ *
+ * Each file normally holds one rank, so this is the per-rank distribution
+ * that load-balance analysis needs. Files merged from several ranks carry
+ * the spread of their ranks. maxFile is the file with the largest total and
+ * maxRank the rank with it: the one recorded in maxFile if that was merged
+ * from several ranks, maxFile itself otherwise. Ranks that don't run the
+ * kernel count as zero time; @p fileCount is the number of ranks that were
+ * read.
+ */
+struct RankSpread {
+  uint64_t files = 0;
+  double sum     = 0;
+  double sumSq   = 0;
+  double min     = 0;
+  double max     = 0;
+  size_t maxFile = 0;
+  size_t maxRank = 0;
+
+  void add(const double time, const size_t file) {
+    if (files == 0 || time < min) min = time;
+    if (files == 0 || time > max) {
+      max     = time;
+      maxFile = file;
+      maxRank = file;
+    }
+    files++;
+    sum += time;
+    sumSq += time * time;
+  }
+
+  void merge(const RankSpread& other) {
+    if (other.files == 0) return;
+    if (files == 0 || other.min < min) min = other.min;
+    if (files == 0 || other.max > max) {
+      max     = other.max;
+      maxFile = other.maxFile;
+      maxRank = other.maxRank;
+    }
+    files += other.files;
+    sum += other.sum;
+    sumSq += other.sumSq;
+  }
+
+  double getMin(const size_t fileCount) const {
+    return files < fileCount ? 0 : min;
+  }
+
+  double getMean(const size_t fileCount) const {
+    return fileCount == 0 ? 0 : sum / fileCount;
+  }
+
+  double getStdDev(const size_t fileCount) const {
+    if (fileCount == 0) return 0;
+    const double mean     = getMean(fileCount);
+    const double variance = sumSq / fileCount - mean * mean;
+    return variance > 0 ? std::sqrt(variance) : 0;
+  }
+
+  /// max/mean - 1: 0 when perfectly balanced, 1 when the slowest rank takes
+  /// twice the average.
+  double getImbalance(const size_t fileCount) const {
+    const double mean = getMean(fileCount);
+    return mean > 0 ? max / mean - 1 : 0;
+  }
+};
+
+/// A record of a .dat file, pointing into the file's mapping.
+struct DatRecordView {
+  std::string_view name;
+  KernelExecutionType kernelType;
+  uint64_t callCount;
+  uint64_t timeNs;
+  double timeSq;
+  uint64_t minNs;
+  uint64_t maxNs;
+  uint32_t deviceID;
+  uint64_t selfNs;
+  RankSpread spread;  // empty unless the file was merged from several ranks
+  const DatBucket* buckets;
+  uint32_t bucketCount;
+  uint32_t histogramLayout;
+
+  /// Merge this record into @p info.
+  void mergeInto(KernelPerformanceInfo& info) const {
+    info.mergeStats(callCount, timeNs, timeSq, minNs, maxNs);
+    info.addSelfTicks(nanosecondsToTicks(selfNs));
+    if (histogramLayout != LatencyHistogram::layout) return;
+    LatencyHistogram& histogram = info.getHistogram();
+    for (uint32_t i = 0; i < bucketCount; i++) {
+      if (buckets[i].index < uint32_t(LatencyHistogram::bucketCount)) {
+        histogram.add(buckets[i].index, buckets[i].count);
+      }
+    }
+  }
+};
+
+/// Encode @p kernels, an iterable of KernelPerformanceInfo pointers, in the
+/// v2 format. For files merged from @p rankCount ranks, @p spreadOf(kernel)
+/// returns the spread of the kernel's per-rank totals.
+template <typename Kernels, typename SpreadOf>
+std::vector<char> encodeDatFile(const double totalExecuteTime,
+                                const Kernels& kernels,
+                                const uint64_t rankCount, SpreadOf&& spreadOf) {
+  std::vector<DatRecord> records;
+  std::vector<DatBucket> buckets;
+  std::string strings;
+  std::unordered_map<std::string_view, uint32_t> stringOffsets;
+
+  for (const KernelPerformanceInfo* kernel : kernels) {
+    const std::string& name = kernel->getName();
+    auto found              = stringOffsets.find(name);
+    if (found == stringOffsets.end()) {
+      found = stringOffsets.emplace(name, uint32_t(strings.size())).first;
+      strings.append(name).push_back('\0');
+    }
+
+    DatRecord record{};
+    record.callCount   = kernel->getCallCount();
+    record.timeNs      = ticksToNanoseconds(kernel->getTicks());
+    record.timeSq      = kernel->getTimeSq();
+    record.minNs       = secondsToNanoseconds(kernel->getMinTime());
+    record.maxNs       = secondsToNanoseconds(kernel->getMaxTime());
+    record.firstBucket = buckets.size();
+    record.kernelType  = kernel->getKernelType();
+    record.nameOffset  = found->second;
+    record.nameLength  = name.size();
+    record.deviceID    = kernel->getDeviceID();
+    record.selfNs      = ticksToNanoseconds(kernel->getSelfTicks());
+    if (rankCount != 0) {
+      const RankSpread& spread = spreadOf(kernel);
+      record.rankCount         = spread.files;
+      record.rankMinNs         = secondsToNanoseconds(spread.min);
+      record.rankMaxNs         = secondsToNanoseconds(spread.max);
+      record.rankSumSq         = spread.sumSq;
+      record.rankMax           = spread.maxRank;
+    }
+
+    const LatencyHistogram& histogram = kernel->getHistogram();
+    for (int i = 0; i < LatencyHistogram::bucketCount; i++) {
+      const uint64_t count = histogram.get(i);
+      if (count != 0) buckets.push_back(DatBucket{uint32_t(i), 0, count});
+    }
+    record.bucketCount = buckets.size() - record.firstBucket;
+    records.push_back(record);
+  }
+
+  std::vector<DatDevice> devices;
+  for (const auto& [device, totals] : sumByDevice(kernels)) {
+    devices.push_back(DatDevice{device, 0, totals.callCount,
+                                secondsToNanoseconds(totals.time)});
+  }
+
+  DatFileHeader header{};
+  memcpy(header.magic, datMagic, sizeof(datMagic));
+  header.version          = datVersion;
+  header.endianMarker     = datEndianMarker;
+  header.headerSize       = sizeof(DatFileHeader);
+  header.recordSize       = sizeof(DatRecord);
+  header.recordCount      = records.size();
+  header.recordsOffset    = sizeof(DatFileHeader);
+  header.bucketCount      = buckets.size();
+  header.bucketsOffset =
+      header.recordsOffset + records.size() * sizeof(DatRecord);
+  header.deviceCount = devices.size();
+  header.devicesOffset =
+      header.bucketsOffset + buckets.size() * sizeof(DatBucket);
+  header.stringsSize = strings.size();
+  header.stringsOffset =
+      header.devicesOffset + devices.size() * sizeof(DatDevice);
+  header.totalExecuteTime = totalExecuteTime;
+  header.histogramLayout  = LatencyHistogram::layout;
+  header.rankCount        = rankCount;
+
+  std::vector<char> image(header.stringsOffset + strings.size());
+  memcpy(image.data(), &header, sizeof(header));
+  memcpy(image.data() + header.recordsOffset, records.data(),
+         records.size() * sizeof(DatRecord));
+  memcpy(image.data() + header.bucketsOffset, buckets.data(),
+         buckets.size() * sizeof(DatBucket));
+  memcpy(image.data() + header.devicesOffset, devices.data(),
+         devices.size() * sizeof(DatDevice));
+  memcpy(image.data() + header.stringsOffset, strings.data(), strings.size());
+  return image;
+}
+
+/// Encode the kernels of a single process.
+template <typename Kernels>
+std::vector<char> encodeDatFile(const double totalExecuteTime,
+                                const Kernels& kernels) {
+  return encodeDatFile(
+      totalExecuteTime, kernels, 0,
+      [](const KernelPerformanceInfo*) { return RankSpread(); });
+}
+
+/// Write @p kernels, an iterable of KernelPerformanceInfo pointers, to
+/// @p output in the v2 format with a single write.
+template <typename Kernels>
+bool writeDatFile(FILE* output, const double totalExecuteTime,
+                  const Kernels& kernels) {
+  const std::vector<char> image = encodeDatFile(totalExecuteTime, kernels);
+  return fwrite(image.data(), image.size(), 1, output) == 1;
+}
+
+/**
+ * @brief Read-only mapping of a .dat file.
+ *
+ * Version 2 files are mapped and their records are visited in place.
+ * Version 1 files are parsed record by record with
+ * KernelPerformanceInfo::readFromFile.
+ */
+class DatFile {
+ public:
+  DatFile() = default;
+  DatFile(const DatFile&) = delete;
+  DatFile& operator=(const DatFile&) = delete;
+  ~DatFile() { close(); }
+
+  /// Open @p path, returning false (with a message in @p error) if it can't
+  /// be read or is not a kernel timer file.
+  bool open(const char* path, std::string& error) {
+    close();
+    filePath = path;
+
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+      error = "cannot open file";
+      return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+      ::close(fd);
+      error = "cannot stat file";
+      return false;
+    }
+    size = info.st_size;
+    if (size > 0) {
+      void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapping == MAP_FAILED) {
+        ::close(fd);
+        error = "cannot map file";
+        return false;
+      }
+      data   = static_cast<const char*>(mapping);
+      mapped = true;
+    }
+    ::close(fd);
+    return parse(error);
+  }
+
+  /// Open the @p length bytes at @p buffer, which must stay valid and
+  /// 8-byte aligned while this is open, e.g. a file received over MPI.
+  /// @p name is only used in messages.
+  bool openBuffer(const char* name, const char* buffer, const size_t length,
+                  std::string& error) {
+    close();
+    filePath = name;
+    data     = buffer;
+    size     = length;
+    return parse(error);
+  }
+
+  void close() {
+    if (mapped) munmap(const_cast<char*>(data), size);
+    data    = nullptr;
+    mapped  = false;
+    size    = 0;
+    version = 0;
+  }
+
+  uint32_t getVersion() const { return version; }
+
+  size_t getSize() const { return size; }
+
+  double getTotalExecuteTime() const { return totalExecuteTime; }
+
+  /// Number of ranks the file was merged from, 1 for the file of a single
+  /// process.
+  uint64_t getRankCount() const {
+    return version == 2 && header.rankCount != 0 ? header.rankCount : 1;
+  }
+
+  /// Per-device kernel totals of a version 2 file. Empty for version 1
+  /// files, whose readers have to sum the records instead.
+  const DatDevice* getDevices(uint64_t& count) const {
+    count = version == 2 ? header.deviceCount : 0;
+    if (count == 0) return nullptr;
+    return reinterpret_cast<const DatDevice*>(data + header.devicesOffset);
+  }
+
+  /// Call @p visit with a DatRecordView for every record. Names are the raw
+  /// names recorded by the tool.
+  template <typename Visit>
+  void forEachRecord(Visit&& visit) const {
+    if (version == 2) {
+      for (uint64_t i = 0; i < header.recordCount; i++) {
+        DatRecord record{};
+        memcpy(&record, data + header.recordsOffset + i * header.recordSize,
+               std::min<size_t>(header.recordSize, sizeof(DatRecord)));
+        if (record.nameOffset + uint64_t(record.nameLength) >
+                header.stringsSize ||
+            record.firstBucket > header.bucketCount ||
+            record.bucketCount > header.bucketCount - record.firstBucket) {
+          fprintf(stderr, "KokkosP: WARNING: %s: record %llu is corrupt\n",
+                  filePath.c_str(), (unsigned long long)i);
+          continue;
+        }
+
+        const char* names = data + header.stringsOffset;
+        const DatBucket* buckets =
+            reinterpret_cast<const DatBucket*>(data + header.bucketsOffset);
+
+        DatRecordView view{};
+        view.name = std::string_view(names + record.nameOffset,
+                                     record.nameLength);
+        view.kernelType      = KernelExecutionType(record.kernelType);
+        view.callCount       = record.callCount;
+        view.timeNs          = record.timeNs;
+        view.timeSq          = record.timeSq;
+        view.minNs           = record.minNs;
+        view.maxNs           = record.maxNs;
+        view.deviceID        = record.deviceID;
+        view.selfNs          = record.selfNs;
+        view.buckets         = buckets + record.firstBucket;
+        if (record.rankCount != 0) {
+          view.spread.files   = record.rankCount;
+          view.spread.sum     = record.timeNs * 1.0e-9;
+          view.spread.sumSq   = record.rankSumSq;
+          view.spread.min     = record.rankMinNs * 1.0e-9;
+          view.spread.max     = record.rankMaxNs * 1.0e-9;
+          view.spread.maxRank = record.rankMax;
+        }
+        view.bucketCount     = record.bucketCount;
+        view.histogramLayout = header.histogramLayout;
+        visit(view);
+      }
+    } else if (version == 1) {
+      forEachV1Record(visit);
+    }
+  }
+
+ private:
+  bool parse(std::string& error) {
+    if (size >= sizeof(datMagic) &&
+        memcmp(data, datMagic, sizeof(datMagic)) == 0) {
+      return validate(error);
+    }
+
+    if (size < sizeof(double)) {
+      error = "file too short";
+      return false;
+    }
+    version = 1;
+    memcpy(&totalExecuteTime, data, sizeof(double));
+    return true;
+  }
+
+  bool validate(std::string& error) {
+    memset(&header, 0, sizeof(header));
+    uint32_t headerSize = 0;
+    if (size >= offsetof(DatFileHeader, headerSize) + sizeof(uint32_t)) {
+      memcpy(&header, data, offsetof(DatFileHeader, headerSize));
+      memcpy(&headerSize, data + offsetof(DatFileHeader, headerSize),
+             sizeof(headerSize));
+    }
+    if (header.endianMarker != datEndianMarker) {
+      error = "file was written with a different byte order";
+      return false;
+    }
+    if (header.version < 2 || header.version > datVersion) {
+      error = "unsupported format version " + std::to_string(header.version) +
+              " (this reader supports versions 1 to " +
+              std::to_string(datVersion) + ")";
+      return false;
+    }
+    if (headerSize < offsetof(DatFileHeader, totalExecuteTime) ||
+        headerSize > size) {
+      error = "truncated header";
+      return false;
+    }
+    memcpy(&header, data, std::min<size_t>(headerSize, sizeof(header)));
+
+    const uint64_t minRecordSize =
+        offsetof(DatRecord, nameLength) + sizeof(uint32_t);
+    if (header.recordSize < minRecordSize ||
+        header.recordsOffset % 8 != 0 || header.bucketsOffset % 8 != 0 ||
+        header.devicesOffset % 8 != 0 ||
+        !fits(header.recordsOffset, header.recordCount, header.recordSize) ||
+        !fits(header.bucketsOffset, header.bucketCount, sizeof(DatBucket)) ||
+        !fits(header.devicesOffset, header.deviceCount, sizeof(DatDevice)) ||
+        !fits(header.stringsOffset, header.stringsSize, 1)) {
+      error = "truncated or corrupt file";
+      return false;
+    }
+
+    version          = header.version;
+    totalExecuteTime = header.totalExecuteTime;
+    return true;
+  }
+
+  /// Whether @p count elements of @p elementSize bytes at @p offset lie
+  /// within the file. Divides rather than multiplies, so that a corrupt
+  /// header can't wrap the end of a section around.
+  bool fits(const uint64_t offset, const uint64_t count,
+            const uint64_t elementSize) const {
+    return offset <= size && count <= (size - offset) / elementSize;
+  }
+
+  template <typename Visit>
+  void forEachV1Record(Visit&& visit) const {
+    FILE* input = fmemopen(const_cast<char*>(data), size, "rb");
+    if (input == nullptr) return;
+    fseek(input, sizeof(double), SEEK_SET);
+
+    std::vector<DatBucket> buckets;
+    for (long offset = ftell(input); offset < long(size);
+         offset      = ftell(input)) {
+      KernelPerformanceInfo kernel("", PARALLEL_FOR);
+      if (!kernel.readFromFile(input, false)) {
+        fprintf(stderr,
+                "KokkosP: WARNING: %s: corrupt or truncated record at byte "
+                "%ld, skipping the rest of the file\n",
+                filePath.c_str(), offset);
+        break;
+      }
+
+      buckets.clear();
+      const LatencyHistogram& histogram = kernel.getHistogram();
+      for (int i = 0; i < LatencyHistogram::bucketCount; i++) {
+        const uint64_t count = histogram.get(i);
+        if (count != 0) buckets.push_back(DatBucket{uint32_t(i), 0, count});
+      }
+
+      DatRecordView view{};
+      view.name            = kernel.getName();
+      view.kernelType      = kernel.getKernelType();
+      view.callCount       = kernel.getCallCount();
+      view.timeNs          = secondsToNanoseconds(kernel.getTime());
+      view.timeSq          = kernel.getTimeSq();
+      view.minNs           = secondsToNanoseconds(kernel.getMinTime());
+      view.maxNs           = secondsToNanoseconds(kernel.getMaxTime());
+      view.deviceID        = kernel.getDeviceID();
+      view.selfNs          = ticksToNanoseconds(kernel.getSelfTicks());
+      view.buckets         = buckets.data();
+      view.bucketCount     = buckets.size();
+      view.histogramLayout = LatencyHistogram::layout;
+      visit(view);
+    }
+    fclose(input);
+  }
+
+  std::string filePath;
+  const char* data = nullptr;
+  bool mapped      = false;
+  size_t size      = 0;
+  uint32_t version = 0;
+  DatFileHeader header{};
+  double totalExecuteTime = 0;
+};
+
+}  // namespace KokkosTools::KernelTimer
+
+#endif  // _H_KOKKOSP_DAT_FORMAT
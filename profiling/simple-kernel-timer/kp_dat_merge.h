@@ -0,0 +1,265 @@
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 4.0
+//       Copyright (2022) National Technology & Engineering
+//               Solutions of Sandia, LLC (NTESS).
+//
+// Under the terms of Contract DE-NA0003525 with NTESS,
+// the U.S. Government retains certain rights in this software.
+//
+// Part of Kokkos, under the Apache License v2.0 with LLVM Exceptions.
+// See https://kokkos.org/LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//@HEADER
+
+#ifndef _H_KOKKOSP_DAT_MERGE
+#define _H_KOKKOSP_DAT_MERGE
+
+#include <stdio.h>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "utils/demangle.hpp"
+
+#include "kp_clock.h"
+#include "kp_dat_format.h"
+#include "kp_kernel_info.h"
+
+namespace KokkosTools::KernelTimer {
+
+/**
+ * @brief Kernels merged by name and devID from a set of .dat files.
+ *
+ * Records are keyed by their raw name while merging, so a name is only
+ * demangled once, when the partial results are combined at the end. Next to
+ * the summed performance data, the spread of the per-file totals is kept.
+ */
+class KernelMerge {
+ public:
+  /// Merge every record of @p file, the @p fileIndex-th input, into this set.
+  /// Files merged from several ranks bring along the spread of their ranks.
+  void add(const DatFile& file, const size_t fileIndex) {
+    totalExecuteTime += file.getTotalExecuteTime();
+    rankCount += file.getRankCount();
+    inputRankCounts[fileIndex] = file.getRankCount();
+    file.forEachRecord([&](const DatRecordView& record) {
+      if (record.name.empty()) return;
+      Entry& entry =
+          findOrInsert(record.name, record.deviceID, record.kernelType);
+      record.mergeInto(entry.info);
+      if (record.spread.files != 0) {
+        RankSpread spread = record.spread;
+        spread.maxFile    = fileIndex;
+        entry.spread.merge(spread);
+      } else {
+        entry.spread.add(record.timeNs * 1.0e-9, fileIndex);
+      }
+    });
+  }
+
+  /// Move the kernels of @p other into this set, adding them up by name.
+  void merge(KernelMerge& other) {
+    totalExecuteTime += other.totalExecuteTime;
+    rankCount += other.rankCount;
+    inputRankCounts.merge(other.inputRankCounts);
+    for (auto& entry : other.entries) {
+      auto found = index.find(keyOf(entry->info));
+      if (found == index.end()) {
+        index.emplace(keyOf(entry->info), entry.get());
+        entries.push_back(std::move(entry));
+      } else {
+        found->second->info.merge(entry->info);
+        found->second->spread.merge(entry->spread);
+      }
+    }
+    other.index.clear();
+    other.entries.clear();
+  }
+
+  /// Replace the raw names with demangled ones, merging kernels whose
+  /// names only differed by mangling. The spread of such kernels is then
+  /// taken over their records rather than per file.
+  void demangle() {
+    KernelMerge demangled;
+    demangled.totalExecuteTime = totalExecuteTime;
+    demangled.rankCount        = rankCount;
+    demangled.inputRankCounts  = std::move(inputRankCounts);
+    for (const auto& entry : entries) {
+      const std::string name = demangleKernelPath(entry->info.getName());
+      Entry& target = demangled.findOrInsert(name, entry->info.getDeviceID(),
+                                             entry->info.getKernelType());
+      target.info.merge(entry->info);
+      target.spread.merge(entry->spread);
+    }
+    *this = std::move(demangled);
+  }
+
+  double getTotalExecuteTime() const { return totalExecuteTime; }
+
+  /// Number of ranks merged, counting every input file as one rank unless
+  /// it was itself merged from several.
+  uint64_t getRankCount() const { return rankCount; }
+
+  /// Number of ranks the @p fileIndex-th input was merged from.
+  uint64_t getInputRankCount(const size_t fileIndex) const {
+    auto found = inputRankCounts.find(fileIndex);
+    return found == inputRankCounts.end() ? 1 : found->second;
+  }
+
+  std::vector<KernelPerformanceInfo*> getKernels() const {
+    std::vector<KernelPerformanceInfo*> list;
+    list.reserve(entries.size());
+    for (const auto& entry : entries) list.push_back(&entry->info);
+    return list;
+  }
+
+  const RankSpread& getSpread(const KernelPerformanceInfo& kernel) const {
+    return index.at(keyOf(kernel))->spread;
+  }
+
+  /// Encode the merged kernels, with their spread, in the v2 format.
+  std::vector<char> encode() const {
+    return encodeDatFile(totalExecuteTime, getKernels(), rankCount,
+                         [this](const KernelPerformanceInfo* kernel) {
+                           return getSpread(*kernel);
+                         });
+  }
+
+ private:
+  struct Entry {
+    Entry(std::string name, KernelExecutionType kernelType, uint32_t devID)
+        : info(std::move(name), kernelType, devID) {}
+
+    KernelPerformanceInfo info;
+    RankSpread spread;
+  };
+
+  struct Key {
+    std::string_view name;
+    uint32_t deviceID;
+
+    bool operator==(const Key& other) const {
+      return deviceID == other.deviceID && name == other.name;
+    }
+  };
+
+  struct KeyHash {
+    size_t operator()(const Key& key) const {
+      return std::hash<std::string_view>()(key.name) ^
+             (key.deviceID * 0x9e3779b97f4a7c15ULL);
+    }
+  };
+
+  static Key keyOf(const KernelPerformanceInfo& info) {
+    return Key{info.getName(), info.getDeviceID()};
+  }
+
+  Entry& findOrInsert(std::string_view name, uint32_t devID,
+                      KernelExecutionType kernelType) {
+    auto found = index.find(Key{name, devID});
+    if (found != index.end()) return *found->second;
+
+    entries.push_back(
+        std::make_unique<Entry>(std::string(name), kernelType, devID));
+    Entry* entry = entries.back().get();
+    index.emplace(keyOf(entry->info), entry);
+    return *entry;
+  }
+
+  // Keys view the names owned by the entries.
+  std::unordered_map<Key, Entry*, KeyHash> index;
+  std::vector<std::unique_ptr<Entry>> entries;
+  std::unordered_map<size_t, uint64_t> inputRankCounts;
+  double totalExecuteTime = 0;
+  uint64_t rankCount      = 0;
+};
+
+struct MergeStatistics {
+  size_t files   = 0;
+  uint64_t ranks = 0;
+  uint64_t bytes = 0;
+  double seconds = 0;
+};
+
+/**
+ * @brief Read and merge @p paths with @p threadCount threads.
+ *
+ * Every thread takes files from a shared counter and merges them into its own
+ * KernelMerge, so no locks are taken while parsing. The partial results are
+ * then combined pairwise in log2(threadCount) rounds. Files that can't be
+ * read are reported and skipped.
+ */
+inline KernelMerge mergeDatFiles(const std::vector<const char*>& paths,
+                                 int threadCount, MergeStatistics& stats) {
+  const uint64_t start = monotonicRawTicks();
+
+  if (threadCount < 1) threadCount = 1;
+  if (size_t(threadCount) > paths.size()) threadCount = paths.size();
+  if (threadCount < 1) threadCount = 1;
+
+  std::vector<KernelMerge> partials(threadCount);
+  std::atomic<size_t> nextFile = 0;
+  std::atomic<size_t> files    = 0;
+  std::atomic<uint64_t> bytes  = 0;
+
+  auto worker = [&](KernelMerge& partial) {
+    for (size_t i = nextFile++; i < paths.size(); i = nextFile++) {
+      DatFile file;
+      std::string error;
+      if (!file.open(paths[i], error)) {
+        fprintf(stderr, "KokkosP: WARNING: skipping %s: %s\n", paths[i],
+                error.c_str());
+        continue;
+      }
+      partial.add(file, i);
+      files++;
+      bytes += file.getSize();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int t = 1; t < threadCount; t++) {
+    threads.emplace_back(worker, std::ref(partials[t]));
+  }
+  worker(partials[0]);
+  for (auto& thread : threads) thread.join();
+
+  for (int stride = 1; stride < threadCount; stride *= 2) {
+    threads.clear();
+    for (int t = stride; t < threadCount; t += 2 * stride) {
+      threads.emplace_back(
+          [&partials, t, stride] { partials[t - stride].merge(partials[t]); });
+    }
+    for (auto& thread : threads) thread.join();
+  }
+
+  partials[0].demangle();
+
+  stats.files   = files;
+  stats.ranks   = partials[0].getRankCount();
+  stats.bytes   = bytes;
+  stats.seconds = (monotonicRawTicks() - start) * 1.0e-9;
+  return std::move(partials[0]);
+}
+
+inline void printMergeStatistics(FILE* output, const MergeStatistics& stats) {
+  const double seconds = stats.seconds > 0 ? stats.seconds : 1.0e-9;
+  fprintf(output,
+          "KokkosP: read %zu files (%.2f MB) in %.3f s: %.1f files/s, "
+          "%.1f MB/s\n",
+          stats.files, stats.bytes * 1.0e-6, stats.seconds,
+          stats.files / seconds, stats.bytes * 1.0e-6 / seconds);
+}
+
+}  // namespace KokkosTools::KernelTimer
+
+#endif  // _H_KOKKOSP_DAT_MERGE
@@ -0,0 +1,118 @@
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 4.0
+//       Copyright (2022) National Technology & Engineering
+//               Solutions of Sandia, LLC (NTESS).
+//
+// Under the terms of Contract DE-NA0003525 with NTESS,
+// the U.S. Government retains certain rights in this software.
+//
+// Part of Kokkos, under the Apache License v2.0 with LLVM Exceptions.
+// See https://kokkos.org/LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//@HEADER
+
+#ifndef _H_KOKKOSP_HISTOGRAM
+#define _H_KOKKOSP_HISTOGRAM
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+
+namespace KokkosTools::KernelTimer {
+
+/**
+ * @brief Fixed-size log-linear histogram of call durations in nanoseconds.
+ *
+ * Values below 2^subBucketBits ns are counted exactly. Above that, every
+ * power-of-two range is split into 2^subBucketBits equal buckets, so a bucket
+ * is never wider than 1/16th of its lower bound and the midpoint is within
+ * ~3% of any value in it. Durations of 2^maxBits ns (~18 minutes) and more
+ * all land in the last bucket.
+ *
+ * Histograms with the same layout merge exactly by adding bucket counts,
+ * which is what allows per-rank histograms to be combined after the fact.
+ */
+class LatencyHistogram {
+ public:
+  static constexpr int subBucketBits  = 4;
+  static constexpr int subBucketCount = 1 << subBucketBits;
+  static constexpr int maxBits        = 40;
+  static constexpr int bucketCount =
+      (maxBits - subBucketBits + 1) * subBucketCount;
+
+  /// Identifies the bucket layout in binary files.
+  static constexpr uint32_t layout = (subBucketBits << 8) | maxBits;
+
+  static int bucketIndex(const uint64_t ns) {
+    if (ns < uint64_t(subBucketCount)) return int(ns);
+    const int msb = 63 - __builtin_clzll(ns);
+    if (msb >= maxBits) return bucketCount - 1;
+    const int group = msb - subBucketBits + 1;
+    const int sub   = int(ns >> (msb - subBucketBits)) & (subBucketCount - 1);
+    return group * subBucketCount + sub;
+  }
+
+  static uint64_t bucketLowerBound(const int index) {
+    const int group = index / subBucketCount;
+    const int sub   = index % subBucketCount;
+    if (group == 0) return uint64_t(sub);
+    return uint64_t(subBucketCount + sub) << (group - 1);
+  }
+
+  static uint64_t bucketWidth(const int index) {
+    const int group = index / subBucketCount;
+    return group == 0 ? 1 : uint64_t(1) << (group - 1);
+  }
+
+  void record(const uint64_t ns) {
+    counts[bucketIndex(ns)].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void add(const int index, const uint64_t count) {
+    counts[index].fetch_add(count, std::memory_order_relaxed);
+  }
+
+  void merge(const LatencyHistogram& other) {
+    for (int i = 0; i < bucketCount; ++i) {
+      const uint64_t count = other.get(i);
+      if (count != 0) add(i, count);
+    }
+  }
+
+  uint64_t get(const int index) const {
+    return counts[index].load(std::memory_order_relaxed);
+  }
+
+  uint64_t total() const {
+    uint64_t sum = 0;
+    for (int i = 0; i < bucketCount; ++i) sum += get(i);
+    return sum;
+  }
+
+  /// Value in ns below which a fraction @p q of the calls fall, reported as
+  /// the midpoint of the bucket holding that rank. Returns 0 if empty.
+  double quantile(const double q) const {
+    const uint64_t n = total();
+    if (n == 0) return 0;
+    uint64_t rank = uint64_t(std::ceil(q * n));
+    if (rank == 0) rank = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < bucketCount; ++i) {
+      seen += get(i);
+      if (seen >= rank) {
+        return bucketLowerBound(i) + 0.5 * (bucketWidth(i) - 1);
+      }
+    }
+    return bucketLowerBound(bucketCount - 1);
+  }
+
+ private:
+  std::atomic<uint64_t> counts[bucketCount]{};
+};
+
+}  // namespace KokkosTools::KernelTimer
+
+#endif  // _H_KOKKOSP_HISTOGRAM
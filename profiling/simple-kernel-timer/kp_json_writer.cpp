@@ -20,9 +20,11 @@
 #include <vector>
 #include <algorithm>
 #include <map>
+#include <thread>
 #include <fstream>
 #include <iostream>
 
+#include "kp_dat_merge.h"
 #include "kp_shared.h"
 
 using namespace KokkosTools::KernelTimer;
@@ -31,12 +33,17 @@ bool is_region(KernelPerformanceInfo const& kp) {
   return kp.getKernelType() == REGION;
 }
 
+bool is_fence(KernelPerformanceInfo const& kp) {
+  return kp.getKernelType() == FENCE;
+}
+
 inline std::string to_string(KernelExecutionType t) {
   switch (t) {
     case PARALLEL_FOR: return "\"PARALLEL_FOR\"";
     case PARALLEL_REDUCE: return "\"PARALLEL_REDUCE\"";
     case PARALLEL_SCAN: return "\"PARALLEL_SCAN\"";
     case REGION: return "\"REGION\"";
+    case FENCE: return "\"FENCE\"";
     default: throw t;
   }
 }
@@ -45,10 +52,21 @@ inline void write_json(std::ostream& os, KernelPerformanceInfo const& kp,
                        std::string indent = "") {
   os << indent << "{\n";
   os << indent << "  \"kernel-name\": \"" << kp.getName() << "\",\n";
+  os << indent << "  \"device\": " << kp.getDevice() << ",\n";
+  os << indent << "  \"instance\": " << kp.getInstance() << ",\n";
   os << indent << "  \"call-count\": " << kp.getCallCount() << ",\n";
   os << indent << "  \"total-time\": " << kp.getTime() << ",\n";
+  if (is_region(kp)) {
+    os << indent << "  \"self-time\": " << kp.getSelfTime() << ",\n";
+  }
   os << indent << "  \"time-per-call\": "
      << kp.getTime() / std::max((uint64_t)1, kp.getCallCount()) << ",\n";
+  os << indent << "  \"min-time\": " << kp.getMinTime() << ",\n";
+  os << indent << "  \"max-time\": " << kp.getMaxTime() << ",\n";
+  os << indent << "  \"p50-time\": " << kp.getPercentile(0.50) << ",\n";
+  os << indent << "  \"p90-time\": " << kp.getPercentile(0.90) << ",\n";
+  os << indent << "  \"p99-time\": " << kp.getPercentile(0.99) << ",\n";
+  os << indent << "  \"p99.9-time\": " << kp.getPercentile(0.999) << ",\n";
   os << indent << "  \"kernel-type\": " << to_string(kp.getKernelType())
      << '\n';
   os << indent << '}';
@@ -57,52 +75,40 @@ inline void write_json(std::ostream& os, KernelPerformanceInfo const& kp,
 int main(int argc, char* argv[]) {
   if (argc == 1) {
     fprintf(stderr, "Did you specify any data files on the command line!\n");
-    fprintf(stderr, "Usage: ./kp_json_writer file1.dat [fileX.dat]*\n");
+    fprintf(stderr,
+            "Usage: ./kp_json_writer [--threads <n>] file1.dat "
+            "[fileX.dat]*\n");
     exit(-1);
   }
 
+  int threads = std::thread::hardware_concurrency();
+
   int commandline_args = 1;
   while ((commandline_args < argc) && (argv[commandline_args][0] == '-')) {
+    if (strcmp(argv[commandline_args], "--threads") == 0) {
+      threads = atoi(argv[++commandline_args]);
+    }
     commandline_args++;
   }
 
-  std::vector<KernelPerformanceInfo*> kernelInfo;
-  double totalKernelsTime    = 0;
-  double totalExecuteTime    = 0;
-  uint64_t totalKernelsCalls = 0;
+  std::vector<const char*> files(argv + commandline_args, argv + argc);
+  MergeStatistics mergeStats;
+  KernelMerge merged = mergeDatFiles(files, threads, mergeStats);
+  printMergeStatistics(stderr, mergeStats);
 
-  for (int i = commandline_args; i < argc; i++) {
-    FILE* the_file = fopen(argv[i], "rb");
-
-    double fileExecuteTime = 0;
-    fread(&fileExecuteTime, sizeof(fileExecuteTime), 1, the_file);
-
-    totalExecuteTime += fileExecuteTime;
-
-    while (!feof(the_file)) {
-      KernelPerformanceInfo* new_kernel =
-          new KernelPerformanceInfo("", PARALLEL_FOR);
-      if (new_kernel->readFromFile(the_file)) {
-        if (!new_kernel->getName().empty()) {
-          int kernelIndex = find_index(kernelInfo, new_kernel->getName());
-
-          if (kernelIndex > -1) {
-            kernelInfo[kernelIndex]->addTime(new_kernel->getTime());
-            kernelInfo[kernelIndex]->addCallCount(new_kernel->getCallCount());
-          } else {
-            kernelInfo.push_back(new_kernel);
-          }
-        }
-      }
-    }
+  std::vector<KernelPerformanceInfo*> kernelInfo = merged.getKernels();
+  const double totalExecuteTime = merged.getTotalExecuteTime();
 
-    fclose(the_file);
-  }
+  double totalKernelsTime    = 0;
+  uint64_t totalKernelsCalls = 0;
+  double totalFencesTime     = 0;
 
   std::sort(kernelInfo.begin(), kernelInfo.end(), compareKernelPerformanceInfo);
 
   for (unsigned int i = 0; i < kernelInfo.size(); i++) {
-    if (kernelInfo[i]->getKernelType() != REGION) {
+    if (is_fence(*kernelInfo[i])) {
+      totalFencesTime += kernelInfo[i]->getTime();
+    } else if (!is_region(*kernelInfo[i])) {
       totalKernelsTime += kernelInfo[i]->getTime();
       totalKernelsCalls += kernelInfo[i]->getCallCount();
     }
@@ -121,6 +127,7 @@ int main(int argc, char* argv[]) {
   fout << "  \"percent-in-kernels\" : "
        << 100. * totalKernelsTime / totalExecuteTime << ",\n";
   fout << "  \"unique-kernel-calls\" : " << totalKernelsCalls << ",\n";
+  fout << "  \"total-fence-time\" : " << totalFencesTime << ",\n";
 
   fout << "  \"region-data\" : [\n";
   {
@@ -139,13 +146,45 @@ int main(int argc, char* argv[]) {
   {
     bool add_comma = false;
     for (auto const& kp : kernelInfo) {
-      if (is_region(*kp)) continue;
+      if (is_region(*kp) || is_fence(*kp)) continue;
       if (add_comma) fout << ",\n";
       add_comma = true;
       write_json(fout, *kp, "    ");
     }
     fout << '\n';
   }
+  fout << "  ],\n";
+
+  fout << "  \"fence-data\" : [\n";
+  {
+    bool add_comma = false;
+    for (auto const& kp : kernelInfo) {
+      if (!is_fence(*kp)) continue;
+      if (add_comma) fout << ",\n";
+      add_comma = true;
+      write_json(fout, *kp, "    ");
+    }
+    fout << '\n';
+  }
+  fout << "  ],\n";
+
+  // Utilization sums all instances of a device and may exceed 1.
+  fout << "  \"device-data\" : [\n";
+  {
+    bool add_comma = false;
+    for (auto const& device : sumByDevice(kernelInfo)) {
+      if (add_comma) fout << ",\n";
+      add_comma = true;
+      fout << "    {\n";
+      fout << "      \"device\": " << device.first << ",\n";
+      fout << "      \"call-count\": " << device.second.callCount << ",\n";
+      fout << "      \"total-time\": " << device.second.time << ",\n";
+      fout << "      \"utilization\": "
+           << device.second.time / totalExecuteTime << '\n';
+      fout << "    }";
+    }
+    fout << '\n';
+  }
   fout << "  ]\n";
 
   fout << "}\n";
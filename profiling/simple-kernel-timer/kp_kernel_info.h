@@ -18,111 +18,255 @@
 #define _H_KOKKOSP_KERNEL_INFO
 
 #include <stdio.h>
-#include <sys/time.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <string>
 #include <cstring>
+#include <map>
+#include <string_view>
 
 #include "utils/demangle.hpp"
 
+#include "kp_clock.h"
+#include "kp_histogram.h"
+
 namespace KokkosTools::KernelTimer {
 
-inline double seconds() {
-  struct timeval now;
-  gettimeofday(&now, NULL);
+inline void atomicAdd(std::atomic<double>& dest, const double value) {
+  double current = dest.load(std::memory_order_relaxed);
+  while (!dest.compare_exchange_weak(current, current + value,
+                                     std::memory_order_relaxed)) {
+  }
+}
+
+inline void atomicMin(std::atomic<uint64_t>& dest, const uint64_t value) {
+  uint64_t current = dest.load(std::memory_order_relaxed);
+  while (value < current &&
+         !dest.compare_exchange_weak(current, value,
+                                     std::memory_order_relaxed)) {
+  }
+}
+
+inline void atomicMax(std::atomic<uint64_t>& dest, const uint64_t value) {
+  uint64_t current = dest.load(std::memory_order_relaxed);
+  while (value > current &&
+         !dest.compare_exchange_weak(current, value,
+                                     std::memory_order_relaxed)) {
+  }
+}
+
+/// Device index encoded in the devID Kokkos passes to the callbacks, see
+/// getDeviceID in kp_sampler_skip.cpp.
+inline uint32_t deviceFromID(const uint32_t devID) {
+  const int num_device_bits   = 7;
+  const int num_instance_bits = 17;
+  return (~((uint32_t(-1)) << num_device_bits)) &
+         (devID >> num_instance_bits);
+}
 
-  return (double)(now.tv_sec + (now.tv_usec * 1.0e-6));
+/// Execution space instance encoded in the devID.
+inline uint32_t instanceFromID(const uint32_t devID) {
+  const int num_instance_bits = 17;
+  return (~((uint32_t(-1)) << num_instance_bits)) & devID;
+}
+
+/// Separates the regions and the kernel name in region path keys, see
+/// KOKKOS_TOOLS_TIMER_REGION_PATH.
+constexpr char regionPathSeparator[] = " > ";
+
+/// Demangle the kernel name at the end of @p name, which may be prefixed
+/// with the region path the kernel was launched in.
+inline std::string demangleKernelPath(const std::string_view name) {
+  const size_t pos = name.rfind(regionPathSeparator);
+  if (pos == std::string_view::npos) return demangleNameKokkos(name);
+  const size_t kernelPos = pos + sizeof(regionPathSeparator) - 1;
+  return std::string(name.substr(0, kernelPos))
+      .append(demangleNameKokkos(name.substr(kernelPos)));
 }
 
 enum KernelExecutionType {
   PARALLEL_FOR    = 0,
   PARALLEL_REDUCE = 1,
   PARALLEL_SCAN   = 2,
-  REGION          = 3
+  REGION          = 3,
+  FENCE           = 4
 };
 
 class KernelPerformanceInfo {
  public:
-  KernelPerformanceInfo(std::string kName, KernelExecutionType kernelType)
-      : kernelName(std::move(kName)), kType(kernelType) {}
+  KernelPerformanceInfo(std::string kName, KernelExecutionType kernelType,
+                        uint32_t devID = 0)
+      : kernelName(std::move(kName)), kType(kernelType), deviceID(devID) {}
 
   KernelExecutionType getKernelType() const { return kType; }
 
-  void incrementCount() { callCount++; }
+  // Kernels may end concurrently on several host threads, so the counters
+  // are updated atomically.
+  void incrementCount() { callCount.fetch_add(1, std::memory_order_relaxed); }
 
-  void addTime(double t) {
-    time += t;
-    timeSq += (t * t);
+  void addTicks(const uint64_t t) {
+    timeTicks.fetch_add(t, std::memory_order_relaxed);
+    atomicAdd(timeSqTicks, double(t) * double(t));
   }
 
-  void addFromTimer() {
-    addTime(seconds() - startTime);
+  void addTime(double t) { addTicks(secondsToTicks(t)); }
 
+  /// Account for @p t ticks of a region spent outside nested regions and
+  /// kernels.
+  void addSelfTicks(const uint64_t t) {
+    selfTicks.fetch_add(t, std::memory_order_relaxed);
+  }
+
+  /// Account for one call lasting @p t ticks.
+  void recordCall(const uint64_t t) {
+    addTicks(t);
     incrementCount();
+    atomicMin(minTicks, t);
+    atomicMax(maxTicks, t);
+    histogram.record(ticksToNanoseconds(t));
+  }
+
+  /// Add the calls recorded in @p other, e.g. read from another rank's file.
+  void merge(const KernelPerformanceInfo& other) {
+    addCallCount(other.getCallCount());
+    timeTicks.fetch_add(other.timeTicks, std::memory_order_relaxed);
+    addSelfTicks(other.selfTicks);
+    atomicAdd(timeSqTicks, other.timeSqTicks);
+    atomicMin(minTicks, other.minTicks);
+    atomicMax(maxTicks, other.maxTicks);
+    histogram.merge(other.histogram);
   }
 
-  void startTimer() { startTime = seconds(); }
+  /// Add pre-aggregated statistics, e.g. read from a binary record.
+  void mergeStats(const uint64_t calls, const uint64_t timeNs,
+                  const double timeSqSeconds, const uint64_t minNs,
+                  const uint64_t maxNs) {
+    addCallCount(calls);
+    timeTicks.fetch_add(nanosecondsToTicks(timeNs), std::memory_order_relaxed);
+    atomicAdd(timeSqTicks, timeSqSeconds / (secondsPerTick * secondsPerTick));
+    if (calls != 0) atomicMin(minTicks, nanosecondsToTicks(minNs));
+    atomicMax(maxTicks, nanosecondsToTicks(maxNs));
+  }
+
+  /// Set this, an empty record, to the calls that @p current recorded on
+  /// top of @p previous, an earlier copy of it. Counters may be updated
+  /// while this runs, so the result is only consistent with @p previous
+  /// plus itself. The extrema are known to the histogram resolution only.
+  void assignDelta(const KernelPerformanceInfo& current,
+                   const KernelPerformanceInfo& previous) {
+    const uint64_t calls = current.callCount;
+    const uint64_t time  = current.timeTicks;
+    const uint64_t self  = current.selfTicks;
+    const double timeSq  = current.timeSqTicks;
+    if (calls <= previous.callCount) return;
+    callCount   = calls - previous.callCount;
+    timeTicks   = time > previous.timeTicks ? time - previous.timeTicks : 0;
+    selfTicks   = self > previous.selfTicks ? self - previous.selfTicks : 0;
+    timeSqTicks = std::max(timeSq - previous.timeSqTicks, 0.0);
+
+    int first = -1, last = -1;
+    for (int i = 0; i < LatencyHistogram::bucketCount; i++) {
+      const uint64_t now = current.histogram.get(i);
+      const uint64_t old = previous.histogram.get(i);
+      if (now <= old) continue;
+      histogram.add(i, now - old);
+      if (first < 0) first = i;
+      last = i;
+    }
+    if (first < 0) return;
+
+    const uint64_t lowNs  = LatencyHistogram::bucketLowerBound(first);
+    const uint64_t highNs = LatencyHistogram::bucketLowerBound(last) +
+                            LatencyHistogram::bucketWidth(last) - 1;
+    minTicks = std::max<uint64_t>(nanosecondsToTicks(lowNs), current.minTicks);
+    maxTicks = std::min<uint64_t>(nanosecondsToTicks(highNs), current.maxTicks);
+  }
 
   uint64_t getCallCount() const { return callCount; }
 
-  double getTime() const { return time; }
+  uint64_t getTicks() const { return timeTicks; }
 
-  double getTimeSq() { return timeSq; }
+  double getTime() const { return ticksToSeconds(timeTicks); }
 
-  const std::string& getName() const { return kernelName; }
+  uint64_t getSelfTicks() const { return selfTicks; }
 
-  void addCallCount(const uint64_t newCalls) { callCount += newCalls; }
+  /// Exclusive time of a region: its time minus that of the regions nested
+  /// in it and of the kernels launched directly in it. 0 for kernels.
+  double getSelfTime() const { return ticksToSeconds(selfTicks); }
 
-  bool readFromFile(FILE* input) {
-    uint32_t recordLen   = 0;
-    uint32_t actual_read = fread(&recordLen, sizeof(recordLen), 1, input);
-    if (actual_read != 1) return false;
+  double getTimeSq() const {
+    return timeSqTicks * secondsPerTick * secondsPerTick;
+  }
 
-    char* entry = (char*)malloc(recordLen);
-    fread(entry, recordLen, 1, input);
+  /// Standard deviation of the duration of a call.
+  double getTimeStdDev() const {
+    const uint64_t calls = getCallCount();
+    if (calls == 0) return 0;
+    const double mean     = getTime() / calls;
+    const double variance = getTimeSq() / calls - mean * mean;
+    return variance > 0 ? std::sqrt(variance) : 0;
+  }
 
-    uint32_t nextIndex = 0;
-    uint32_t kernelNameLength;
-    copy((char*)&kernelNameLength, &entry[nextIndex], sizeof(kernelNameLength));
-    nextIndex += sizeof(kernelNameLength);
+  double getMinTime() const {
+    return minTicks == ~uint64_t(0) ? 0 : ticksToSeconds(minTicks);
+  }
 
-    this->kernelName = std::string(&entry[nextIndex], kernelNameLength);
+  double getMaxTime() const { return ticksToSeconds(maxTicks); }
 
-    kernelName = demangleNameKokkos(kernelName);
+  /// Duration of a call at quantile @p q, accurate to the histogram bucket
+  /// and clamped to the exact extrema.
+  double getPercentile(const double q) const {
+    if (histogram.total() == 0) return 0;
+    const double t = histogram.quantile(q) * 1.0e-9;
+    return std::min(std::max(t, getMinTime()), getMaxTime());
+  }
 
-    nextIndex += kernelNameLength;
+  const LatencyHistogram& getHistogram() const { return histogram; }
 
-    copy((char*)&callCount, &entry[nextIndex], sizeof(callCount));
-    nextIndex += sizeof(callCount);
+  LatencyHistogram& getHistogram() { return histogram; }
 
-    copy((char*)&time, &entry[nextIndex], sizeof(time));
-    nextIndex += sizeof(time);
+  const std::string& getName() const { return kernelName; }
 
-    copy((char*)&timeSq, &entry[nextIndex], sizeof(timeSq));
-    nextIndex += sizeof(timeSq);
+  /// The devID the kernel was launched with; 0 for regions.
+  uint32_t getDeviceID() const { return deviceID; }
 
-    uint32_t kernelT = 0;
-    copy((char*)&kernelT, &entry[nextIndex], sizeof(kernelT));
-    nextIndex += sizeof(kernelT);
+  uint32_t getDevice() const { return deviceFromID(deviceID); }
 
-    if (kernelT == 0) {
-      kType = PARALLEL_FOR;
-    } else if (kernelT == 1) {
-      kType = PARALLEL_REDUCE;
-    } else if (kernelT == 2) {
-      kType = PARALLEL_SCAN;
-    } else if (kernelT == 3) {
-      kType = REGION;
-    }
+  uint32_t getInstance() const { return instanceFromID(deviceID); }
 
+  void addCallCount(const uint64_t newCalls) {
+    callCount.fetch_add(newCalls, std::memory_order_relaxed);
+  }
+
+  /// Reads a record written by writeToBinaryFile. Returns false at the end
+  /// of the file, and for a record whose fields run past its length.
+  bool readFromFile(FILE* input, const bool demangle = true) {
+    uint32_t recordLen   = 0;
+    uint32_t actual_read = fread(&recordLen, sizeof(recordLen), 1, input);
+    if (actual_read != 1) return false;
+
+    char* entry = (char*)malloc(recordLen);
+    if (entry == nullptr) return false;
+    const bool valid = fread(entry, recordLen, 1, input) == 1 &&
+                       readEntry(entry, recordLen, demangle);
     free(entry);
-    return true;
+    return valid;
   }
 
   void writeToBinaryFile(FILE* output) {
+    uint32_t bucketCount = 0;
+    for (int i = 0; i < LatencyHistogram::bucketCount; i++) {
+      if (histogram.get(i) != 0) bucketCount++;
+    }
+
     const uint32_t kernelNameLen = kernelName.size();
-    const uint32_t recordLen = sizeof(uint32_t) + sizeof(char) * kernelNameLen +
-                               sizeof(uint64_t) + sizeof(double) +
-                               sizeof(double) + sizeof(uint32_t);
+    const uint32_t recordLen =
+        sizeof(uint32_t) + sizeof(char) * kernelNameLen + sizeof(uint64_t) +
+        sizeof(double) + sizeof(double) + sizeof(uint32_t) + sizeof(double) +
+        sizeof(double) + sizeof(uint32_t) + sizeof(uint32_t) +
+        bucketCount * (sizeof(uint32_t) + sizeof(uint64_t)) + sizeof(uint32_t) +
+        sizeof(double);
 
     uint32_t nextIndex = 0;
     char* entry        = (char*)malloc(recordLen);
@@ -133,19 +277,56 @@ class KernelPerformanceInfo {
     copy(&entry[nextIndex], kernelName.c_str(), kernelNameLen);
     nextIndex += kernelNameLen;
 
-    copy(&entry[nextIndex], (char*)&callCount, sizeof(callCount));
-    nextIndex += sizeof(callCount);
+    const uint64_t entryCallCount = callCount;
+    copy(&entry[nextIndex], (char*)&entryCallCount, sizeof(entryCallCount));
+    nextIndex += sizeof(entryCallCount);
 
-    copy(&entry[nextIndex], (char*)&time, sizeof(time));
-    nextIndex += sizeof(time);
+    const double entryTime = getTime();
+    copy(&entry[nextIndex], (char*)&entryTime, sizeof(entryTime));
+    nextIndex += sizeof(entryTime);
 
-    copy(&entry[nextIndex], (char*)&timeSq, sizeof(timeSq));
-    nextIndex += sizeof(timeSq);
+    const double entryTimeSq = getTimeSq();
+    copy(&entry[nextIndex], (char*)&entryTimeSq, sizeof(entryTimeSq));
+    nextIndex += sizeof(entryTimeSq);
 
     uint32_t kernelTypeOutput = (uint32_t)kType;
     copy(&entry[nextIndex], (char*)&kernelTypeOutput, sizeof(kernelTypeOutput));
     nextIndex += sizeof(kernelTypeOutput);
 
+    const double entryMinTime = getMinTime();
+    copy(&entry[nextIndex], (char*)&entryMinTime, sizeof(entryMinTime));
+    nextIndex += sizeof(entryMinTime);
+
+    const double entryMaxTime = getMaxTime();
+    copy(&entry[nextIndex], (char*)&entryMaxTime, sizeof(entryMaxTime));
+    nextIndex += sizeof(entryMaxTime);
+
+    const uint32_t layout = LatencyHistogram::layout;
+    copy(&entry[nextIndex], (char*)&layout, sizeof(layout));
+    nextIndex += sizeof(layout);
+
+    copy(&entry[nextIndex], (char*)&bucketCount, sizeof(bucketCount));
+    nextIndex += sizeof(bucketCount);
+
+    for (int i = 0; i < LatencyHistogram::bucketCount; i++) {
+      const uint64_t count = histogram.get(i);
+      if (count == 0) continue;
+
+      const uint32_t index = i;
+      copy(&entry[nextIndex], (char*)&index, sizeof(index));
+      nextIndex += sizeof(index);
+
+      copy(&entry[nextIndex], (char*)&count, sizeof(count));
+      nextIndex += sizeof(count);
+    }
+
+    copy(&entry[nextIndex], (char*)&deviceID, sizeof(deviceID));
+    nextIndex += sizeof(deviceID);
+
+    const double entrySelfTime = getSelfTime();
+    copy(&entry[nextIndex], (char*)&entrySelfTime, sizeof(entrySelfTime));
+    nextIndex += sizeof(entrySelfTime);
+
     fwrite(&recordLen, sizeof(uint32_t), 1, output);
     fwrite(entry, recordLen, 1, output);
     free(entry);
@@ -161,17 +342,38 @@ class KernelPerformanceInfo {
             kernelName.c_str());
     // fprintf(output, "%s\"region\"         : \"%s\",\n", indentBuffer,
     // regionName);
+    fprintf(output, "%s\"device\"         : %u,\n", indentBuffer,
+            getDevice());
+    fprintf(output, "%s\"instance\"       : %u,\n", indentBuffer,
+            getInstance());
     fprintf(output, "%s\"call-count\"     : %llu,\n", indentBuffer,
-            (unsigned long long)(callCount));
-    fprintf(output, "%s\"total-time\"     : %f,\n", indentBuffer, time);
+            (unsigned long long)(getCallCount()));
+    fprintf(output, "%s\"total-time\"     : %f,\n", indentBuffer, getTime());
+    if (kType == REGION) {
+      fprintf(output, "%s\"self-time\"      : %f,\n", indentBuffer,
+              getSelfTime());
+    }
     fprintf(output, "%s\"time-per-call\"  : %16.8f,\n", indentBuffer,
-            (time / static_cast<double>(
-                        std::max(static_cast<uint64_t>(1), callCount))));
-    fprintf(
-        output, "%s\"kernel-type\"    : \"%s\"\n", indentBuffer,
-        (kType == PARALLEL_FOR)
-            ? "PARALLEL-FOR"
-            : (kType == PARALLEL_REDUCE) ? "PARALLEL-REDUCE" : "PARALLEL-SCAN");
+            (getTime() / static_cast<double>(std::max(
+                             static_cast<uint64_t>(1), getCallCount()))));
+    fprintf(output, "%s\"min-time\"       : %16.8f,\n", indentBuffer,
+            getMinTime());
+    fprintf(output, "%s\"max-time\"       : %16.8f,\n", indentBuffer,
+            getMaxTime());
+    fprintf(output, "%s\"p50-time\"       : %16.8f,\n", indentBuffer,
+            getPercentile(0.50));
+    fprintf(output, "%s\"p90-time\"       : %16.8f,\n", indentBuffer,
+            getPercentile(0.90));
+    fprintf(output, "%s\"p99-time\"       : %16.8f,\n", indentBuffer,
+            getPercentile(0.99));
+    fprintf(output, "%s\"p99.9-time\"     : %16.8f,\n", indentBuffer,
+            getPercentile(0.999));
+    fprintf(output, "%s\"kernel-type\"    : \"%s\"\n", indentBuffer,
+            (kType == PARALLEL_FOR)      ? "PARALLEL-FOR"
+            : (kType == PARALLEL_REDUCE) ? "PARALLEL-REDUCE"
+            : (kType == PARALLEL_SCAN)   ? "PARALLEL-SCAN"
+            : (kType == FENCE)           ? "FENCE"
+                                         : "REGION");
 
     fprintf(output, "%s}", indent);
   }
@@ -183,15 +385,145 @@ class KernelPerformanceInfo {
     }
   }
 
+  bool readEntry(const char* entry, const uint32_t recordLen,
+                 const bool demangle) {
+    uint32_t nextIndex = 0;
+    uint32_t kernelNameLength;
+    if (!copyField((char*)&kernelNameLength, entry, recordLen, nextIndex,
+                   sizeof(kernelNameLength)) ||
+        kernelNameLength > recordLen - nextIndex) {
+      return false;
+    }
+
+    this->kernelName = std::string(&entry[nextIndex], kernelNameLength);
+
+    if (demangle) kernelName = demangleKernelPath(kernelName);
+
+    nextIndex += kernelNameLength;
+
+    uint64_t entryCallCount = 0;
+    double entryTime        = 0;
+    double entryTimeSq      = 0;
+    uint32_t kernelT        = 0;
+    if (!copyField((char*)&entryCallCount, entry, recordLen, nextIndex,
+                   sizeof(entryCallCount)) ||
+        !copyField((char*)&entryTime, entry, recordLen, nextIndex,
+                   sizeof(entryTime)) ||
+        !copyField((char*)&entryTimeSq, entry, recordLen, nextIndex,
+                   sizeof(entryTimeSq)) ||
+        !copyField((char*)&kernelT, entry, recordLen, nextIndex,
+                   sizeof(kernelT))) {
+      return false;
+    }
+    callCount   = entryCallCount;
+    timeTicks   = secondsToTicks(entryTime);
+    timeSqTicks = entryTimeSq / (secondsPerTick * secondsPerTick);
+
+    if (kernelT == 0) {
+      kType = PARALLEL_FOR;
+    } else if (kernelT == 1) {
+      kType = PARALLEL_REDUCE;
+    } else if (kernelT == 2) {
+      kType = PARALLEL_SCAN;
+    } else if (kernelT == 3) {
+      kType = REGION;
+    } else if (kernelT == 4) {
+      kType = FENCE;
+    }
+
+    // Records written before the extrema and histogram were added end here.
+    double entryMinTime  = 0;
+    double entryMaxTime  = 0;
+    uint32_t layout      = 0;
+    uint32_t bucketCount = 0;
+    if (!copyField((char*)&entryMinTime, entry, recordLen, nextIndex,
+                   sizeof(entryMinTime))) {
+      return true;
+    }
+    if (!copyField((char*)&entryMaxTime, entry, recordLen, nextIndex,
+                   sizeof(entryMaxTime)) ||
+        !copyField((char*)&layout, entry, recordLen, nextIndex,
+                   sizeof(layout)) ||
+        !copyField((char*)&bucketCount, entry, recordLen, nextIndex,
+                   sizeof(bucketCount))) {
+      return false;
+    }
+    if (callCount != 0) minTicks = secondsToTicks(entryMinTime);
+    maxTicks = secondsToTicks(entryMaxTime);
+
+    for (uint32_t i = 0; i < bucketCount; i++) {
+      uint32_t index = 0;
+      uint64_t count = 0;
+      if (!copyField((char*)&index, entry, recordLen, nextIndex,
+                     sizeof(index)) ||
+          !copyField((char*)&count, entry, recordLen, nextIndex,
+                     sizeof(count))) {
+        return false;
+      }
+      if (layout == LatencyHistogram::layout &&
+          index < uint32_t(LatencyHistogram::bucketCount)) {
+        histogram.add(index, count);
+      }
+    }
+
+    // Records written before the device was added end here.
+    if (!copyField((char*)&deviceID, entry, recordLen, nextIndex,
+                   sizeof(deviceID))) {
+      return true;
+    }
+
+    // Records written before the self time was added end here.
+    double entrySelfTime = 0;
+    if (copyField((char*)&entrySelfTime, entry, recordLen, nextIndex,
+                  sizeof(entrySelfTime))) {
+      selfTicks = secondsToTicks(entrySelfTime);
+    }
+    return true;
+  }
+
+  /// Copies the field of @p len bytes at @p nextIndex of a record of
+  /// @p recordLen bytes and moves past it, unless it runs past the record.
+  bool copyField(char* dest, const char* entry, const uint32_t recordLen,
+                 uint32_t& nextIndex, const uint32_t len) {
+    if (len > recordLen - nextIndex) return false;
+    copy(dest, &entry[nextIndex], len);
+    nextIndex += len;
+    return true;
+  }
+
   std::string kernelName;
   // const char* regionName;
+  std::atomic<uint64_t> callCount = 0;
+  std::atomic<uint64_t> timeTicks = 0;
+  std::atomic<uint64_t> selfTicks = 0;
+  std::atomic<double> timeSqTicks = 0;
+  std::atomic<uint64_t> minTicks  = ~uint64_t(0);
+  std::atomic<uint64_t> maxTicks  = 0;
+  LatencyHistogram histogram;
+  KernelExecutionType kType;
+  uint32_t deviceID;
+};
+
+struct DeviceTotals {
   uint64_t callCount = 0;
   double time        = 0;
-  double timeSq      = 0;
-  double startTime   = 0;
-  KernelExecutionType kType;
 };
 
+/// Kernel calls and time per device, summed over its instances. Regions and
+/// fences don't occupy a device and are left out.
+template <typename Kernels>
+std::map<uint32_t, DeviceTotals> sumByDevice(const Kernels& kernels) {
+  std::map<uint32_t, DeviceTotals> devices;
+  for (const KernelPerformanceInfo* kernel : kernels) {
+    if (kernel->getKernelType() == REGION || kernel->getKernelType() == FENCE)
+      continue;
+    DeviceTotals& totals = devices[kernel->getDevice()];
+    totals.callCount += kernel->getCallCount();
+    totals.time += kernel->getTime();
+  }
+  return devices;
+}
+
 }  // namespace KokkosTools::KernelTimer
 
 #endif
@@ -0,0 +1,241 @@
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 4.0
+//       Copyright (2022) National Technology & Engineering
+//               Solutions of Sandia, LLC (NTESS).
+//
+// Under the terms of Contract DE-NA0003525 with NTESS,
+// the U.S. Government retains certain rights in this software.
+//
+// Part of Kokkos, under the Apache License v2.0 with LLVM Exceptions.
+// See https://kokkos.org/LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//@HEADER
+
+#ifndef _H_KOKKOSP_KERNEL_TABLE
+#define _H_KOKKOSP_KERNEL_TABLE
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+#include "kp_kernel_info.h"
+
+namespace KokkosTools::KernelTimer {
+
+/**
+ * @brief Open-addressing lookup of kernel records by label.
+ *
+ * Kokkos hands the same label pointer to the begin callbacks over and over,
+ * so the first level is keyed on the address of the label. Since that address
+ * may be a recycled buffer holding another label, a hit is only accepted if
+ * the content still matches the interned name of the record.
+ *
+ * The second level is keyed on a hash of the label content and holds every
+ * interned name. Neither level allocates for a label that has been seen
+ * before; only new names reach the @c insert callback.
+ *
+ * Launches of the same kernel on different devices or execution space
+ * instances get separate records, so both levels also match the devID.
+ */
+class KernelLookupTable {
+ public:
+  KernelLookupTable() { resize(initialCapacity); }
+
+  /// Find the record for @p name on @p devID, calling @p insert(label) to
+  /// create it if the pair has never been seen.
+  template <typename Insert>
+  KernelPerformanceInfo* findOrInsert(const char* name, const uint32_t devID,
+                                      Insert&& insert) {
+    const AddressSlot& hint = addressSlots[addressIndex(name, devID)];
+    if (hint.label == name && hint.info != nullptr &&
+        hint.info->getDeviceID() == devID && matches(hint.info, name)) {
+      return hint.info;
+    }
+
+    KernelPerformanceInfo* info = findOrInsertName(name, devID, insert);
+    addressSlots[addressIndex(name, devID)] = AddressSlot{name, info};
+    return info;
+  }
+
+  /// Find the record for @p label on @p devID by content only, for labels
+  /// built in a buffer that is reused for every lookup, whose address tells
+  /// nothing about the label.
+  template <typename Insert>
+  KernelPerformanceInfo* findOrInsertName(const std::string_view label,
+                                          const uint32_t devID,
+                                          Insert&& insert) {
+    const uint64_t hash = hashName(label) ^ (devID * 0x9e3779b97f4a7c15ULL);
+
+    KernelPerformanceInfo* info = findName(label, devID, hash);
+    if (info == nullptr) {
+      info = insert(label);
+      insertName(info, hash);  // may rehash both levels
+    }
+    return info;
+  }
+
+  size_t size() const { return nameCount; }
+
+  /// 64-bit FNV-1a of the label content.
+  static uint64_t hashName(std::string_view label) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const char c : label) {
+      hash ^= static_cast<unsigned char>(c);
+      hash *= 0x100000001b3ULL;
+    }
+    return hash;
+  }
+
+ private:
+  struct AddressSlot {
+    const char* label           = nullptr;
+    KernelPerformanceInfo* info = nullptr;
+  };
+
+  struct NameSlot {
+    uint64_t hash               = 0;
+    KernelPerformanceInfo* info = nullptr;
+  };
+
+  static constexpr size_t initialCapacity = 256;
+
+  static bool matches(const KernelPerformanceInfo* info, const char* name) {
+    return strcmp(info->getName().c_str(), name) == 0;
+  }
+
+  size_t addressIndex(const char* name, const uint32_t devID) const {
+    // Labels are at least 8-byte aligned more often than not, so drop the low
+    // bits before mixing with a Fibonacci multiplier.
+    const uint64_t key = (reinterpret_cast<uintptr_t>(name) >> 3) ^
+                         (uint64_t(devID) << 40);
+    return (key * 0x9e3779b97f4a7c15ULL) >> addressShift;
+  }
+
+  KernelPerformanceInfo* findName(std::string_view label, uint32_t devID,
+                                  uint64_t hash) const {
+    const size_t mask = nameSlots.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+      const NameSlot& slot = nameSlots[i];
+      if (slot.info == nullptr) return nullptr;
+      if (slot.hash == hash && slot.info->getDeviceID() == devID &&
+          slot.info->getName() == label) {
+        return slot.info;
+      }
+    }
+  }
+
+  void insertName(KernelPerformanceInfo* info, uint64_t hash) {
+    if (2 * (nameCount + 1) > nameSlots.size()) {
+      resize(2 * nameSlots.size());
+    }
+    const size_t mask = nameSlots.size() - 1;
+    size_t i          = hash & mask;
+    while (nameSlots[i].info != nullptr) i = (i + 1) & mask;
+    nameSlots[i] = NameSlot{hash, info};
+    nameCount++;
+  }
+
+  void resize(size_t capacity) {
+    std::vector<NameSlot> oldSlots(capacity);
+    oldSlots.swap(nameSlots);
+
+    // The address cache only ever holds hints, so it is simply dropped.
+    addressSlots.assign(capacity, AddressSlot{});
+    addressShift = 64;
+    for (size_t c = capacity; c > 1; c >>= 1) addressShift--;
+
+    const size_t mask = capacity - 1;
+    for (const NameSlot& slot : oldSlots) {
+      if (slot.info == nullptr) continue;
+      size_t i = slot.hash & mask;
+      while (nameSlots[i].info != nullptr) i = (i + 1) & mask;
+      nameSlots[i] = slot;
+    }
+  }
+
+  std::vector<AddressSlot> addressSlots;
+  std::vector<NameSlot> nameSlots;
+  size_t nameCount = 0;
+  int addressShift = 64;
+};
+
+/**
+ * @brief Lock-free table of in-flight kernel launches.
+ *
+ * A launch claims a free slot when it begins and the slot index is encoded
+ * in the kernel ID handed back to Kokkos, so the matching end callback finds
+ * its record and start time directly, whatever else started or ended in
+ * between on other execution space instances or host threads. Slots are
+ * claimed with a compare-and-swap and released by their owner only.
+ */
+class KernelLaunchTable {
+ public:
+  static constexpr size_t capacity = 4096;
+
+  /// Returned when every slot is taken; the launch is then not timed.
+  static constexpr uint64_t invalidID = ~uint64_t(0);
+
+  /// Claim a slot for the @p seq-th launch and return its kernel ID.
+  uint64_t open(const uint64_t seq, KernelPerformanceInfo* info,
+                const uint64_t startTicks, const uint32_t deviceID) {
+    for (size_t probe = 0; probe < capacity; ++probe) {
+      const size_t index = (seq + probe) % capacity;
+      Slot& slot         = slots[index];
+      uint64_t expected  = 0;
+      if (slot.tag.load(std::memory_order_relaxed) != 0 ||
+          !slot.tag.compare_exchange_strong(expected, busy,
+                                            std::memory_order_acquire)) {
+        continue;
+      }
+      slot.info       = info;
+      slot.startTicks = startTicks;
+      slot.deviceID   = deviceID;
+
+      const uint64_t kID = seq * capacity + index;
+      slot.tag.store(kID + 1, std::memory_order_release);
+      return kID;
+    }
+    return invalidID;
+  }
+
+  /// Device ID the launch @p kID was made on, if it is in flight.
+  bool device(const uint64_t kID, uint32_t& deviceID) const {
+    if (kID == invalidID) return false;
+    const Slot& slot = slots[kID % capacity];
+    if (slot.tag.load(std::memory_order_acquire) != kID + 1) return false;
+    deviceID = slot.deviceID;
+    return true;
+  }
+
+  /// Release the slot of @p kID. Returns nullptr if @p kID is not in flight.
+  KernelPerformanceInfo* close(const uint64_t kID, uint64_t& startTicks) {
+    if (kID == invalidID) return nullptr;
+    Slot& slot = slots[kID % capacity];
+    if (slot.tag.load(std::memory_order_acquire) != kID + 1) return nullptr;
+    KernelPerformanceInfo* info = slot.info;
+    startTicks                  = slot.startTicks;
+    slot.tag.store(0, std::memory_order_release);
+    return info;
+  }
+
+ private:
+  static constexpr uint64_t busy = ~uint64_t(0);
+
+  struct alignas(64) Slot {
+    std::atomic<uint64_t> tag   = 0;
+    KernelPerformanceInfo* info = nullptr;
+    uint64_t startTicks         = 0;
+    uint32_t deviceID           = 0;
+  };
+
+  Slot slots[capacity];
+};
+
+}  // namespace KokkosTools::KernelTimer
+
+#endif  // _H_KOKKOSP_KERNEL_TABLE
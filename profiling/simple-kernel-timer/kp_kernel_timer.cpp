@@ -22,6 +22,11 @@
 
 #include "kp_core.hpp"
 #include "kp_shared.h"
+#include "kp_snapshot.h"
+
+#if USE_MPI
+#include "kp_mpi_reduce.h"
+#endif
 
 namespace KokkosTools {
 namespace KernelTimer {
@@ -30,6 +35,259 @@ bool is_region(KernelPerformanceInfo const& kp) {
   return kp.getKernelType() == REGION;
 }
 
+bool kokkos_tools_timer_json() {
+  const char* kokkos_tools_timer_json_raw = getenv("KOKKOS_TOOLS_TIMER_JSON");
+  return kokkos_tools_timer_json_raw == NULL
+             ? false
+             : strcmp(kokkos_tools_timer_json_raw, "1") == 0 ||
+                   strcmp(kokkos_tools_timer_json_raw, "true") == 0 ||
+                   strcmp(kokkos_tools_timer_json_raw, "True") == 0;
+}
+
+bool kokkos_tools_timer_region_path() {
+  const char* region_path_raw = getenv("KOKKOS_TOOLS_TIMER_REGION_PATH");
+  return region_path_raw == NULL ? false
+                                 : strcmp(region_path_raw, "1") == 0 ||
+                                       strcmp(region_path_raw, "true") == 0 ||
+                                       strcmp(region_path_raw, "True") == 0;
+}
+
+bool write_binary_file(FILE* output_data, const double totalExecuteTime,
+                       const std::vector<KernelPerformanceInfo*>& kernels) {
+  // Version 1 files can still be requested for older readers.
+  const char* dat_version = getenv("KOKKOS_TOOLS_TIMER_DAT_VERSION");
+  if (dat_version != NULL && strcmp(dat_version, "1") == 0) {
+    fwrite(&totalExecuteTime, sizeof(totalExecuteTime), 1, output_data);
+
+    for (auto kernel : kernels) {
+      kernel->writeToBinaryFile(output_data);
+    }
+    return ferror(output_data) == 0;
+  }
+  return writeDatFile(output_data, totalExecuteTime, kernels);
+}
+
+bool write_json_file(FILE* output_data, const double totalExecuteTime,
+                     const std::vector<KernelPerformanceInfo*>& kernels) {
+  double kernelTimes = 0;
+  double fenceTimes  = 0;
+  for (auto kernel : kernels) {
+    if (kernel->getKernelType() == FENCE) {
+      fenceTimes += kernel->getTime();
+    } else {
+      kernelTimes += kernel->getTime();
+    }
+  }
+
+  fprintf(output_data, "{\n\"kokkos-kernel-data\" : {\n");
+  fprintf(output_data, "    \"total-app-time\"         : %10.3f,\n",
+          totalExecuteTime);
+  fprintf(output_data, "    \"total-kernel-times\"     : %10.3f,\n",
+          kernelTimes);
+  fprintf(output_data, "    \"total-non-kernel-times\" : %10.3f,\n",
+          (totalExecuteTime - kernelTimes));
+
+  const double percentKokkos = (kernelTimes / totalExecuteTime) * 100.0;
+  fprintf(output_data, "    \"percent-in-kernels\"     : %6.2f,\n",
+          percentKokkos);
+  fprintf(output_data, "    \"unique-kernel-calls\"    : %22llu,\n",
+          (unsigned long long)kernels.size());
+  fprintf(output_data, "    \"total-fence-times\"      : %10.3f,\n",
+          fenceTimes);
+  fprintf(output_data, "\n");
+
+  fprintf(output_data, "    \"region-perf-info\"       : [\n");
+
+#define KERNEL_INFO_INDENT "       "
+
+  bool print_comma = false;
+  for (auto kernel : kernels) {
+    if (!is_region(*kernel)) continue;
+    if (print_comma) fprintf(output_data, ",\n");
+    kernel->writeToJSONFile(output_data, KERNEL_INFO_INDENT);
+    print_comma = true;
+  }
+
+  fprintf(output_data, "\n");
+  fprintf(output_data, "    ],\n");
+
+  fprintf(output_data, "    \"kernel-perf-info\"       : [\n");
+
+  print_comma = false;
+  for (auto kernel : kernels) {
+    if (is_region(*kernel) || kernel->getKernelType() == FENCE) continue;
+    if (print_comma) fprintf(output_data, ",\n");
+    kernel->writeToJSONFile(output_data, KERNEL_INFO_INDENT);
+    print_comma = true;
+  }
+
+  fprintf(output_data, "\n");
+  fprintf(output_data, "    ],\n");
+
+  fprintf(output_data, "    \"fence-perf-info\"        : [\n");
+
+  print_comma = false;
+  for (auto kernel : kernels) {
+    if (kernel->getKernelType() != FENCE) continue;
+    if (print_comma) fprintf(output_data, ",\n");
+    kernel->writeToJSONFile(output_data, KERNEL_INFO_INDENT);
+    print_comma = true;
+  }
+
+  fprintf(output_data, "\n");
+  fprintf(output_data, "    ],\n");
+
+  // Utilization adds up the kernels of every instance of a device, so it
+  // exceeds 100% when instances run concurrently.
+  fprintf(output_data, "    \"device-perf-info\"       : [\n");
+
+  print_comma = false;
+  for (const auto& device : sumByDevice(kernels)) {
+    if (print_comma) fprintf(output_data, ",\n");
+    const double utilization =
+        totalExecuteTime > 0 ? device.second.time / totalExecuteTime : 0;
+    fprintf(output_data, KERNEL_INFO_INDENT "{\n");
+    fprintf(output_data, KERNEL_INFO_INDENT "    \"device\"         : %u,\n",
+            device.first);
+    fprintf(output_data, KERNEL_INFO_INDENT "    \"call-count\"     : %llu,\n",
+            (unsigned long long)device.second.callCount);
+    fprintf(output_data, KERNEL_INFO_INDENT "    \"total-time\"     : %f,\n",
+            device.second.time);
+    fprintf(output_data, KERNEL_INFO_INDENT "    \"utilization\"    : %f\n",
+            utilization);
+    fprintf(output_data, KERNEL_INFO_INDENT "}");
+    print_comma = true;
+  }
+
+  fprintf(output_data, "\n");
+  fprintf(output_data, "    ]\n");
+
+  fprintf(output_data, "}\n}");
+  return ferror(output_data) == 0;
+}
+
+SnapshotThread snapshot_thread;
+
+#if USE_MPI
+/**
+ * With KOKKOS_TOOLS_TIMER_MPI_REDUCE=1, the ranks are merged at finalize and
+ * rank 0 writes a single <host>-<pid>.merged.dat, whose records carry the
+ * min, max and average of each kernel's total time over the ranks. With
+ * "node", the ranks of each node are merged first and the lowest rank of a
+ * node also writes <host>-<pid>.node.dat for its node.
+ */
+enum MpiReduceMode { MPI_REDUCE_OFF, MPI_REDUCE_MERGE, MPI_REDUCE_NODE };
+
+MpiReduceMode mpi_reduce_mode = MPI_REDUCE_OFF;
+
+void write_merged_file(const char* suffix, const KernelMerge& merged) {
+  char hostname[256];
+  gethostname(hostname, 256);
+  char fileOutput[512];
+  snprintf(fileOutput, 512, "%s-%d.%s.dat", hostname, (int)getpid(), suffix);
+
+  const std::vector<char> image = merged.encode();
+  FILE* output_data             = fopen(fileOutput, "wb");
+  bool written                  = false;
+  if (output_data != NULL) {
+    written = fwrite(image.data(), image.size(), 1, output_data) == 1;
+    written = fclose(output_data) == 0 && written;
+  }
+  if (!written) {
+    fprintf(stderr, "KokkosP: ERROR: failed to write %s\n", fileOutput);
+    return;
+  }
+
+  char currentwd[256];
+  getcwd(currentwd, 256);
+  printf("KokkosP: Kernel timing of %llu ranks written to %s/%s \n",
+         (unsigned long long)merged.getRankCount(), currentwd, fileOutput);
+}
+
+/// Merge the kernels of all ranks and write the merged files. Returns false,
+/// without communicating, if MPI is not initialized or already finalized.
+bool reduce_over_mpi(const double totalExecuteTime,
+                     const std::vector<KernelPerformanceInfo*>& kernels) {
+  int initialized = 0, finalized = 0;
+  MPI_Initialized(&initialized);
+  MPI_Finalized(&finalized);
+  if (!initialized || finalized) return false;
+
+  // A communicator of our own keeps our messages apart from the
+  // application's.
+  MPI_Comm world;
+  MPI_Comm_dup(MPI_COMM_WORLD, &world);
+  int rank;
+  MPI_Comm_rank(world, &rank);
+
+  KernelMerge merged;
+  const std::vector<char> image = encodeDatFile(totalExecuteTime, kernels);
+  DatFile file;
+  std::string error;
+  if (file.openBuffer("local", image.data(), image.size(), error)) {
+    merged.add(file, rank);
+  }
+
+  MPI_Comm ranks = world;
+  if (mpi_reduce_mode == MPI_REDUCE_NODE) {
+    MPI_Comm node;
+    MPI_Comm_split_type(world, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL,
+                        &node);
+    reduceOverMPI(merged, node);
+    int node_rank;
+    MPI_Comm_rank(node, &node_rank);
+    MPI_Comm_free(&node);
+    if (node_rank == 0) write_merged_file("node", merged);
+
+    // Rank 0 is the lowest rank of its node and so the root of the leaders.
+    MPI_Comm_split(world, node_rank == 0 ? 0 : MPI_UNDEFINED, rank, &ranks);
+  }
+
+  if (ranks != MPI_COMM_NULL) {
+    reduceOverMPI(merged, ranks);
+    if (rank == 0) write_merged_file("merged", merged);
+    if (ranks != world) MPI_Comm_free(&ranks);
+  }
+  MPI_Comm_free(&world);
+  return true;
+}
+#endif
+
+/**
+ * Kernels on asynchronous back-ends return as soon as they are launched. In
+ * the fence modes the end of a kernel is only taken once it completed:
+ *
+ * - global: Kokkos is asked to fence before every callback, see
+ *   kokkosp_request_tool_settings.
+ * - tpi: the timer fences the device of the kernel itself through the tool
+ *   programming interface before taking the end time. These fences are not
+ *   recorded, so kernel times include execution but no other work.
+ *
+ * In both modes fences are recorded as FENCE entries, so that the time spent
+ * waiting in user fences (and in global mode, in the fences Kokkos inserts)
+ * is reported separately from the kernels.
+ */
+enum FenceMode {
+  FENCE_MODE_OFF    = 0,
+  FENCE_MODE_GLOBAL = 1,
+  FENCE_MODE_TPI    = 2
+};
+
+FenceMode fence_mode                             = FENCE_MODE_OFF;
+Kokkos_Tools_toolInvokedFenceFunction tool_fence = nullptr;
+thread_local bool fence_tool_active              = false;
+
+void fence_kernel(const uint64_t kID) {
+  uint32_t devID = 0;
+  if (fence_mode != FENCE_MODE_TPI || tool_fence == nullptr ||
+      !launch_table.device(kID, devID)) {
+    return;
+  }
+  fence_tool_active = true;
+  tool_fence(devID);
+  fence_tool_active = false;
+}
+
 void kokkosp_init_library(const int loadSeq, const uint64_t interfaceVer,
                           const uint32_t /*devInfoCount*/,
                           Kokkos_Profiling_KokkosPDeviceInfo* /*deviceInfo*/) {
@@ -43,104 +301,115 @@ void kokkosp_init_library(const int loadSeq, const uint64_t interfaceVer,
     strcpy(outputDelimiter, output_delim_env);
   }
 
-  // initialize regions to 0s so we know if there is an object there
-  memset(&regions[0], 0, 512 * sizeof(KernelPerformanceInfo*));
+  selectClockSource(getenv("KOKKOS_TOOLS_TIMER_CLOCK"));
+
+  const char* fence_mode_env = getenv("KOKKOS_TOOLS_TIMER_FENCES");
+  if (fence_mode_env != NULL && strcmp(fence_mode_env, "global") == 0) {
+    fence_mode = FENCE_MODE_GLOBAL;
+  } else if (fence_mode_env != NULL && strcmp(fence_mode_env, "tpi") == 0) {
+    fence_mode = FENCE_MODE_TPI;
+  } else if (fence_mode_env != NULL && strcmp(fence_mode_env, "off") != 0) {
+    fprintf(stderr,
+            "KokkosP: WARNING: ignoring KOKKOS_TOOLS_TIMER_FENCES=%s, "
+            "expected global, tpi or off\n",
+            fence_mode_env);
+  }
+
+  region_path_keys = kokkos_tools_timer_region_path();
+
+#if USE_MPI
+  const char* mpi_reduce_env = getenv("KOKKOS_TOOLS_TIMER_MPI_REDUCE");
+  if (mpi_reduce_env != NULL && (strcmp(mpi_reduce_env, "1") == 0 ||
+                                 strcmp(mpi_reduce_env, "true") == 0)) {
+    mpi_reduce_mode = MPI_REDUCE_MERGE;
+  } else if (mpi_reduce_env != NULL && strcmp(mpi_reduce_env, "node") == 0) {
+    mpi_reduce_mode = MPI_REDUCE_NODE;
+  } else if (mpi_reduce_env != NULL && strcmp(mpi_reduce_env, "0") != 0) {
+    fprintf(stderr,
+            "KokkosP: WARNING: ignoring KOKKOS_TOOLS_TIMER_MPI_REDUCE=%s, "
+            "expected 1, node or 0\n",
+            mpi_reduce_env);
+  }
+  if (mpi_reduce_mode != MPI_REDUCE_OFF && kokkos_tools_timer_json()) {
+    fprintf(stderr,
+            "KokkosP: WARNING: ranks are merged into .dat files, convert them "
+            "with kp_json_writer\n");
+  }
+#endif
 
   printf(
       "KokkosP: Simple Kernel Timer Library Initialized (sequence is %d, "
       "version: %llu)\n",
       loadSeq, (unsigned long long)(interfaceVer));
+  if (clockSource == CLOCK_SOURCE_TSC) {
+    printf("KokkosP: Timing kernels with the TSC (%.3f GHz)\n",
+           1.0e-9 / secondsPerTick);
+  }
+  if (fence_mode != FENCE_MODE_OFF) {
+    printf("KokkosP: Fencing kernels (%s) and timing fences\n",
+           fence_mode == FENCE_MODE_GLOBAL ? "global" : "tpi");
+  }
+  if (region_path_keys) {
+    printf("KokkosP: Keying kernels by the regions they are launched in\n");
+  }
 
-  initTime = seconds();
+  initTime = ticks();
+
+  const char* snapshot_interval = getenv("KOKKOS_TOOLS_TIMER_SNAPSHOT");
+  if (snapshot_interval != NULL) {
+    const bool json = kokkos_tools_timer_json();
+    if (!snapshot_thread.start(snapshot_interval, json ? "json" : "dat",
+                               json ? write_json_file : write_binary_file)) {
+      fprintf(stderr,
+              "KokkosP: WARNING: ignoring KOKKOS_TOOLS_TIMER_SNAPSHOT=%s, "
+              "expected a positive <seconds> or a whole <launches>l\n",
+              snapshot_interval);
+    } else if (snapshot_thread.getLaunches() != 0) {
+      printf("KokkosP: Writing snapshots every %llu kernel launches\n",
+             (unsigned long long)snapshot_thread.getLaunches());
+    } else {
+      printf("KokkosP: Writing snapshots every %g seconds\n",
+             snapshot_thread.getSeconds());
+    }
+  }
 }
 
 void kokkosp_finalize_library() {
-  double finishTime = seconds();
+  snapshot_thread.stop();
 
-  const char* kokkos_tools_timer_json_raw = getenv("KOKKOS_TOOLS_TIMER_JSON");
-  const bool kokkos_tools_timer_json =
-      kokkos_tools_timer_json_raw == NULL
-          ? false
-          : strcmp(kokkos_tools_timer_json_raw, "1") == 0 ||
-                strcmp(kokkos_tools_timer_json_raw, "true") == 0 ||
-                strcmp(kokkos_tools_timer_json_raw, "True") == 0;
+  const uint64_t finishTime = ticks();
 
-  double kernelTimes = 0;
+  std::vector<KernelPerformanceInfo*> kernelList;
+  for (auto kernel_itr = count_map.begin(); kernel_itr != count_map.end();
+       kernel_itr++) {
+    kernelList.push_back(kernel_itr->second);
+  }
+
+  const double totalExecuteTime = ticksToSeconds(finishTime - initTime);
+
+#if USE_MPI
+  if (mpi_reduce_mode != MPI_REDUCE_OFF &&
+      reduce_over_mpi(totalExecuteTime, kernelList)) {
+    return;
+  }
+#endif
 
   char* hostname = (char*)malloc(sizeof(char) * 256);
   gethostname(hostname, 256);
 
   char* fileOutput = (char*)malloc(sizeof(char) * 256);
   snprintf(fileOutput, 256, "%s-%d.%s", hostname, (int)getpid(),
-           kokkos_tools_timer_json ? "json" : "dat");
+           kokkos_tools_timer_json() ? "json" : "dat");
 
   free(hostname);
   FILE* output_data = fopen(fileOutput, "wb");
 
-  const double totalExecuteTime = (finishTime - initTime);
-  if (!kokkos_tools_timer_json) {
-    fwrite(&totalExecuteTime, sizeof(totalExecuteTime), 1, output_data);
-
-    for (auto kernel_itr = count_map.begin(); kernel_itr != count_map.end();
-         kernel_itr++) {
-      kernel_itr->second->writeToBinaryFile(output_data);
-    }
-  } else {
-    std::vector<KernelPerformanceInfo*> kernelList;
-
-    for (auto kernel_itr = count_map.begin(); kernel_itr != count_map.end();
-         kernel_itr++) {
-      kernelList.push_back(kernel_itr->second);
-      kernelTimes += kernel_itr->second->getTime();
-    }
-
-    std::sort(kernelList.begin(), kernelList.end(),
-              compareKernelPerformanceInfo);
-
-    fprintf(output_data, "{\n\"kokkos-kernel-data\" : {\n");
-    fprintf(output_data, "    \"total-app-time\"         : %10.3f,\n",
-            totalExecuteTime);
-    fprintf(output_data, "    \"total-kernel-times\"     : %10.3f,\n",
-            kernelTimes);
-    fprintf(output_data, "    \"total-non-kernel-times\" : %10.3f,\n",
-            (totalExecuteTime - kernelTimes));
-
-    const double percentKokkos = (kernelTimes / totalExecuteTime) * 100.0;
-    fprintf(output_data, "    \"percent-in-kernels\"     : %6.2f,\n",
-            percentKokkos);
-    fprintf(output_data, "    \"unique-kernel-calls\"    : %22llu,\n",
-            (unsigned long long)count_map.size());
-    fprintf(output_data, "\n");
-
-    fprintf(output_data, "    \"region-perf-info\"       : [\n");
-
-#define KERNEL_INFO_INDENT "       "
-
-    bool print_comma = false;
-    for (auto const& kernel : count_map) {
-      if (!is_region(*std::get<1>(kernel))) continue;
-      if (print_comma) fprintf(output_data, ",\n");
-      kernel.second->writeToJSONFile(output_data, KERNEL_INFO_INDENT);
-      print_comma = true;
-    }
-
-    fprintf(output_data, "\n");
-    fprintf(output_data, "    ],\n");
-
-    fprintf(output_data, "    \"kernel-perf-info\"       : [\n");
-
-    print_comma = false;
-    for (auto const& kernel : count_map) {
-      if (is_region(*std::get<1>(kernel))) continue;
-      if (print_comma) fprintf(output_data, ",\n");
-      kernel.second->writeToJSONFile(output_data, KERNEL_INFO_INDENT);
-      print_comma = true;
-    }
-
-    fprintf(output_data, "\n");
-    fprintf(output_data, "    ]\n");
-
-    fprintf(output_data, "}\n}");
+  const bool written =
+      kokkos_tools_timer_json()
+          ? write_json_file(output_data, totalExecuteTime, kernelList)
+          : write_binary_file(output_data, totalExecuteTime, kernelList);
+  if (!written) {
+    fprintf(stderr, "KokkosP: ERROR: failed to write %s\n", fileOutput);
   }
 
   fclose(output_data);
@@ -262,52 +531,68 @@ void kokkosp_finalize_library() {
   }*/
 }
 
-void kokkosp_begin_parallel_for(const char* name, const uint32_t /*devID*/,
+void kokkosp_begin_parallel_for(const char* name, const uint32_t devID,
                                 uint64_t* kID) {
-  *kID = uniqID++;
-
   if ((NULL == name) || (strcmp("", name) == 0)) {
     fprintf(stderr, "Error: kernel is empty\n");
     exit(-1);
   }
 
-  increment_counter(name, PARALLEL_FOR);
+  *kID = increment_counter(name, PARALLEL_FOR, devID);
 }
 
-void kokkosp_end_parallel_for(const uint64_t /*kID*/) {
-  currentEntry->addFromTimer();
+void kokkosp_end_parallel_for(const uint64_t kID) {
+  fence_kernel(kID);
+  end_counter(kID);
 }
 
-void kokkosp_begin_parallel_scan(const char* name, const uint32_t /*devID*/,
+void kokkosp_begin_parallel_scan(const char* name, const uint32_t devID,
                                  uint64_t* kID) {
-  *kID = uniqID++;
-
   if ((NULL == name) || (strcmp("", name) == 0)) {
     fprintf(stderr, "Error: kernel is empty\n");
     exit(-1);
   }
 
-  increment_counter(name, PARALLEL_SCAN);
+  *kID = increment_counter(name, PARALLEL_SCAN, devID);
 }
 
-void kokkosp_end_parallel_scan(const uint64_t /*kID*/) {
-  currentEntry->addFromTimer();
+void kokkosp_end_parallel_scan(const uint64_t kID) {
+  fence_kernel(kID);
+  end_counter(kID);
 }
 
-void kokkosp_begin_parallel_reduce(const char* name, const uint32_t /*devID*/,
+void kokkosp_begin_parallel_reduce(const char* name, const uint32_t devID,
                                    uint64_t* kID) {
-  *kID = uniqID++;
-
   if ((NULL == name) || (strcmp("", name) == 0)) {
     fprintf(stderr, "Error: kernel is empty\n");
     exit(-1);
   }
 
-  increment_counter(name, PARALLEL_REDUCE);
+  *kID = increment_counter(name, PARALLEL_REDUCE, devID);
 }
 
-void kokkosp_end_parallel_reduce(const uint64_t /*kID*/) {
-  currentEntry->addFromTimer();
+void kokkosp_end_parallel_reduce(const uint64_t kID) {
+  fence_kernel(kID);
+  end_counter(kID);
+}
+
+void kokkosp_begin_fence(const char* name, const uint32_t devID,
+                         uint64_t* handle) {
+  *handle = KernelLaunchTable::invalidID;
+  if (fence_mode == FENCE_MODE_OFF || fence_tool_active) return;
+  *handle = increment_counter(name, FENCE, devID);
+}
+
+void kokkosp_end_fence(const uint64_t handle) { end_counter(handle); }
+
+void kokkosp_request_tool_settings(const uint32_t,
+                                   Kokkos_Tools_ToolSettings* settings) {
+  settings->requires_global_fencing = fence_mode == FENCE_MODE_GLOBAL;
+}
+
+void kokkosp_provide_tool_programming_interface(
+    const uint32_t num_actions, Kokkos_Tools_ToolProgrammingInterface* tpi) {
+  if (num_actions > 0) tool_fence = tpi->fence;
 }
 
 void kokkosp_push_profile_region(char const* regionName) {
@@ -315,32 +600,19 @@ void kokkosp_push_profile_region(char const* regionName) {
 }
 
 void kokkosp_pop_profile_region() {
-  current_region_level--;
-
-  // current_region_level is out of bounds, inform the user they
-  // called popRegion too many times.
-  if (current_region_level < 0) {
-    current_region_level = 0;
+  // No region is open, inform the user they called popRegion too many times.
+  if (!decrement_counter_region()) {
     std::cerr << "WARNING:: Kokkos::Profiling::popRegion() called outside "
               << " of an actve region. Previous regions: ";
 
-    /* This code block will walk back through the non-null regions
-     * pointers and print the names.  This takes advantage of a slight
-     * issue with regions logic: we never actually delete the
-     * KernelPerformanceInfo objects.  If that ever changes this needs
-     * to be updated.
+    /* This code block will walk back through the popped frames of the
+     * region stack and print the names.  This takes advantage of the
+     * stack never shrinking: frames are only reused by later pushes.
      */
-    for (int i = 0; i < 5; i++) {
-      if (regions[i] != 0) {
-        std::cerr << (i == 0 ? " " : ";") << regions[i]->getName();
-      } else {
-        break;
-      }
+    for (size_t i = 0; i < 5 && i < region_stack.size(); i++) {
+      std::cerr << (i == 0 ? " " : ";") << region_stack[i].info->getName();
     }
     std::cerr << "\n";
-  } else {
-    // don't call addFromTimer if we are outside an active region
-    regions[current_region_level]->addFromTimer();
   }
 }
 
@@ -358,6 +630,16 @@ Kokkos::Tools::Experimental::EventSet get_event_set() {
   my_event_set.end_parallel_scan     = kokkosp_end_parallel_scan;
   my_event_set.push_region           = kokkosp_push_profile_region;
   my_event_set.pop_region            = kokkosp_pop_profile_region;
+  my_event_set.begin_fence           = kokkosp_begin_fence;
+  my_event_set.end_fence             = kokkosp_end_fence;
+  my_event_set.request_tool_settings = kokkosp_request_tool_settings;
+  // The event set hands the interface over by value, the exported symbol
+  // by pointer.
+  my_event_set.provide_tool_programming_interface =
+      [](const uint32_t num_actions,
+         Kokkos_Tools_ToolProgrammingInterface tpi) {
+        kokkosp_provide_tool_programming_interface(num_actions, &tpi);
+      };
   return my_event_set;
 }
 
@@ -378,5 +660,10 @@ EXPOSE_BEGIN_PARALLEL_REDUCE(impl::kokkosp_begin_parallel_reduce)
 EXPOSE_END_PARALLEL_REDUCE(impl::kokkosp_end_parallel_reduce)
 EXPOSE_PUSH_REGION(impl::kokkosp_push_profile_region)
 EXPOSE_POP_REGION(impl::kokkosp_pop_profile_region)
+EXPOSE_BEGIN_FENCE(impl::kokkosp_begin_fence)
+EXPOSE_END_FENCE(impl::kokkosp_end_fence)
+EXPOSE_TOOL_SETTINGS(impl::kokkosp_request_tool_settings)
+EXPOSE_PROVIDE_TOOL_PROGRAMMING_INTERFACE(
+    impl::kokkosp_provide_tool_programming_interface)
 
 }  // extern "C"
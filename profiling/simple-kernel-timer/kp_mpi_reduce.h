@@ -0,0 +1,98 @@
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 4.0
+//       Copyright (2022) National Technology & Engineering
+//               Solutions of Sandia, LLC (NTESS).
+//
+// Under the terms of Contract DE-NA0003525 with NTESS,
+// the U.S. Government retains certain rights in this software.
+//
+// Part of Kokkos, under the Apache License v2.0 with LLVM Exceptions.
+// See https://kokkos.org/LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//@HEADER
+
+#ifndef _H_KOKKOSP_MPI_REDUCE
+#define _H_KOKKOSP_MPI_REDUCE
+
+#include <stdio.h>
+#include <mpi.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "kp_dat_merge.h"
+
+namespace KokkosTools::KernelTimer {
+
+/// MPI counts are ints, so images go as their length followed by chunks of
+/// at most this many bytes. Messages between two ranks arrive in order.
+constexpr size_t mpiMaxChunk = size_t(1) << 30;
+
+inline void sendImage(const std::vector<char>& image, const int dest,
+                      MPI_Comm comm) {
+  const uint64_t length = image.size();
+  MPI_Send(&length, 1, MPI_UINT64_T, dest, 0, comm);
+  for (size_t offset = 0; offset < image.size(); offset += mpiMaxChunk) {
+    const size_t chunk = std::min(mpiMaxChunk, image.size() - offset);
+    MPI_Send(image.data() + offset, int(chunk), MPI_BYTE, dest, 0, comm);
+  }
+}
+
+inline std::vector<char> receiveImage(const int source, MPI_Comm comm) {
+  uint64_t length = 0;
+  MPI_Recv(&length, 1, MPI_UINT64_T, source, 0, comm, MPI_STATUS_IGNORE);
+  std::vector<char> image(length);
+  for (size_t offset = 0; offset < image.size(); offset += mpiMaxChunk) {
+    const size_t chunk = std::min(mpiMaxChunk, image.size() - offset);
+    MPI_Recv(image.data() + offset, int(chunk), MPI_BYTE, source, 0, comm,
+             MPI_STATUS_IGNORE);
+  }
+  return image;
+}
+
+/**
+ * @brief Merge the kernels of every rank of @p comm into its rank 0.
+ *
+ * The ranks form a binomial tree: in round k, each rank with bit k set sends
+ * what it merged so far to the rank 2^k below it and drops out. A rank thus
+ * receives at most log2(size) messages and only ever holds its own subtree.
+ *
+ * Messages are .dat files in the v2 format, so every name is sent once per
+ * message through the string table, and the spread of the per-rank totals
+ * travels along in the records. Records of the calling rank must already be
+ * in @p merged, added with its rank in MPI_COMM_WORLD as the file index.
+ */
+inline void reduceOverMPI(KernelMerge& merged, MPI_Comm comm) {
+  int rank, size;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+
+  for (int step = 1; step < size; step *= 2) {
+    if (rank & step) {
+      sendImage(merged.encode(), rank - step, comm);
+      return;
+    }
+    if (rank + step >= size) continue;
+
+    const std::vector<char> image = receiveImage(rank + step, comm);
+
+    const std::string name = "rank " + std::to_string(rank + step);
+    DatFile file;
+    std::string error;
+    if (!file.openBuffer(name.c_str(), image.data(), image.size(), error)) {
+      fprintf(stderr, "KokkosP: WARNING: skipping %s: %s\n", name.c_str(),
+              error.c_str());
+      continue;
+    }
+    merged.add(file, rank + step);
+  }
+}
+
+}  // namespace KokkosTools::KernelTimer
+
+#endif  // _H_KOKKOSP_MPI_REDUCE
@@ -20,20 +20,70 @@
 #include <vector>
 #include <algorithm>
 #include <map>
+#include <string>
+#include <thread>
 
+#include "kp_dat_merge.h"
 #include "kp_shared.h"
 
 using namespace KokkosTools::KernelTimer;
 
+const char* type_label(KernelExecutionType type, bool fixed_width) {
+  switch (type) {
+    case PARALLEL_FOR: return " (ParFor)  ";
+    case PARALLEL_REDUCE: return " (ParRed)  ";
+    case PARALLEL_SCAN: return " (ParScan) ";
+    case FENCE: return " (Fence)   ";
+    default: return fixed_width ? " (Region)  " : " (REGION)  ";
+  }
+}
+
+void print_percentiles(KernelPerformanceInfo const& kp, char delimiter,
+                       int fixed_width) {
+  if (fixed_width)
+    printf("%11s%c%15.5e%c%15.5e%c%15.5e%c%15.5e%c%15.5e%c%15.5e\n", "",
+           delimiter, kp.getMinTime(), delimiter, kp.getPercentile(0.50),
+           delimiter, kp.getPercentile(0.90), delimiter, kp.getPercentile(0.99),
+           delimiter, kp.getPercentile(0.999), delimiter, kp.getMaxTime());
+  else
+    printf("%c%e%c%e%c%e%c%e%c%e%c%e\n", delimiter, kp.getMinTime(), delimiter,
+           kp.getPercentile(0.50), delimiter, kp.getPercentile(0.90),
+           delimiter, kp.getPercentile(0.99), delimiter,
+           kp.getPercentile(0.999), delimiter, kp.getMaxTime());
+}
+
+void print_rank_spread(KernelPerformanceInfo const& kp,
+                       RankSpread const& spread, size_t files,
+                       const char* max_file, char delimiter, int fixed_width) {
+  if (fixed_width)
+    printf("%11s%c%15.5f%c%15.5f%c%15.5f%c%15.5f%c%7.3f%c%15.5e%c%s\n", "",
+           delimiter, spread.getMin(files), delimiter, spread.getMean(files),
+           delimiter, spread.max, delimiter, spread.getStdDev(files),
+           delimiter, spread.getImbalance(files), delimiter,
+           kp.getTimeStdDev(), delimiter, max_file);
+  else
+    printf("%c%f%c%f%c%f%c%f%c%f%c%e%c%s\n", delimiter, spread.getMin(files),
+           delimiter, spread.getMean(files), delimiter, spread.max, delimiter,
+           spread.getStdDev(files), delimiter, spread.getImbalance(files),
+           delimiter, kp.getTimeStdDev(), delimiter, max_file);
+}
+
 int main(int argc, char* argv[]) {
   if (argc == 1) {
     fprintf(stderr, "Did you specify any data files on the command line!\n");
-    fprintf(stderr, "Usage: ./reader file1.dat [fileX.dat]*\n");
+    fprintf(stderr,
+            "Usage: ./reader [--delimiter <c>] [--fixed-width <n>] "
+            "[--percentiles] [--ranks] [--self-time] [--threads <n>] "
+            "file1.dat [fileX.dat]*\n");
     exit(-1);
   }
 
-  char delimiter  = ' ';
-  int fixed_width = 0;
+  char delimiter   = ' ';
+  int fixed_width  = 0;
+  bool percentiles = false;
+  bool ranks       = false;
+  bool self_time   = false;
+  int threads      = std::thread::hardware_concurrency();
 
   int commandline_args = 1;
   while ((commandline_args < argc) && (argv[commandline_args][0] == '-')) {
@@ -43,55 +93,106 @@ int main(int argc, char* argv[]) {
     if (strcmp(argv[commandline_args], "--fixed-width") == 0) {
       fixed_width = atoi(argv[++commandline_args]);
     }
+    if (strcmp(argv[commandline_args], "--percentiles") == 0) {
+      percentiles = true;
+    }
+    if (strcmp(argv[commandline_args], "--ranks") == 0) {
+      ranks = true;
+    }
+    if (strcmp(argv[commandline_args], "--self-time") == 0) {
+      self_time = true;
+    }
+    if (strcmp(argv[commandline_args], "--threads") == 0) {
+      threads = atoi(argv[++commandline_args]);
+    }
 
     commandline_args++;
   }
 
-  std::vector<KernelPerformanceInfo*> kernelInfo;
-  double totalKernelsTime    = 0;
-  double totalExecuteTime    = 0;
-  uint64_t totalKernelsCalls = 0;
-
-  for (int i = commandline_args; i < argc; i++) {
-    FILE* the_file = fopen(argv[i], "rb");
+  std::vector<const char*> files(argv + commandline_args, argv + argc);
+  MergeStatistics mergeStats;
+  KernelMerge merged = mergeDatFiles(files, threads, mergeStats);
+  printMergeStatistics(stderr, mergeStats);
 
-    double fileExecuteTime = 0;
-    fread(&fileExecuteTime, sizeof(fileExecuteTime), 1, the_file);
+  std::vector<KernelPerformanceInfo*> kernelInfo = merged.getKernels();
+  const double totalExecuteTime = merged.getTotalExecuteTime();
 
-    totalExecuteTime += fileExecuteTime;
-
-    while (!feof(the_file)) {
-      KernelPerformanceInfo* new_kernel =
-          new KernelPerformanceInfo("", PARALLEL_FOR);
-      if (new_kernel->readFromFile(the_file)) {
-        if (!new_kernel->getName().empty()) {
-          int kernelIndex = find_index(kernelInfo, new_kernel->getName());
-
-          if (kernelIndex > -1) {
-            kernelInfo[kernelIndex]->addTime(new_kernel->getTime());
-            kernelInfo[kernelIndex]->addCallCount(new_kernel->getCallCount());
-          } else {
-            kernelInfo.push_back(new_kernel);
-          }
-        }
-      }
-    }
-
-    fclose(the_file);
-  }
+  double totalKernelsTime    = 0;
+  uint64_t totalKernelsCalls = 0;
+  double totalFencesTime     = 0;
+  uint64_t totalFencesCalls  = 0;
 
   std::sort(kernelInfo.begin(), kernelInfo.end(), compareKernelPerformanceInfo);
 
   for (unsigned int i = 0; i < kernelInfo.size(); i++) {
-    if (kernelInfo[i]->getKernelType() != REGION) {
+    if (kernelInfo[i]->getKernelType() == FENCE) {
+      totalFencesTime += kernelInfo[i]->getTime();
+      totalFencesCalls += kernelInfo[i]->getCallCount();
+    } else if (kernelInfo[i]->getKernelType() != REGION) {
       totalKernelsTime += kernelInfo[i]->getTime();
       totalKernelsCalls += kernelInfo[i]->getCallCount();
     }
   }
 
+  auto print_kernel = [&](KernelPerformanceInfo const& kp) {
+    const double callCountDouble = (double)kp.getCallCount();
+
+    // Kernels of the default instance of the host keep their bare name.
+    std::string name = kp.getName();
+    if (kp.getDeviceID() != 0) {
+      name += " [device " + std::to_string(kp.getDevice()) + ", instance " +
+              std::to_string(kp.getInstance()) + "]";
+    }
+
+    if (fixed_width)
+      printf("- %100s\n%11s%c%15.5f%c%12" PRIu64 "%c%15.5f%c%7.3f%c%7.3f\n",
+             name.c_str(), type_label(kp.getKernelType(), true),
+             delimiter, kp.getTime(), delimiter, kp.getCallCount(), delimiter,
+             kp.getTime() / callCountDouble, delimiter,
+             (kp.getTime() / totalKernelsTime) * 100.0, delimiter,
+             (kp.getTime() / totalExecuteTime) * 100.0);
+    else
+      printf("- %s\n%s%c%f%c%" PRIu64 "%c%f%c%f%c%f\n", name.c_str(),
+             type_label(kp.getKernelType(), false), delimiter, kp.getTime(),
+             delimiter, kp.getCallCount(), delimiter,
+             kp.getTime() / callCountDouble, delimiter,
+             (kp.getTime() / totalKernelsTime) * 100.0, delimiter,
+             (kp.getTime() / totalExecuteTime) * 100.0);
+    if (self_time && kp.getKernelType() == REGION) {
+      if (fixed_width)
+        printf("%11s%c%15.5f%c%7.3f\n", "", delimiter, kp.getSelfTime(),
+               delimiter, (kp.getSelfTime() / totalExecuteTime) * 100.0);
+      else
+        printf("%c%f%c%f\n", delimiter, kp.getSelfTime(), delimiter,
+               (kp.getSelfTime() / totalExecuteTime) * 100.0);
+    }
+    if (percentiles) print_percentiles(kp, delimiter, fixed_width);
+    if (ranks) {
+      // Files merged from several ranks by the tool also name the rank.
+      const RankSpread& spread = merged.getSpread(kp);
+      std::string max_file     = files[spread.maxFile];
+      if (merged.getInputRankCount(spread.maxFile) > 1) {
+        max_file += " rank " + std::to_string(spread.maxRank);
+      }
+      print_rank_spread(kp, spread, mergeStats.ranks, max_file.c_str(),
+                        delimiter, fixed_width);
+    }
+  };
+
   printf(
       " (Type)   Total Time, Call Count, Avg. Time per Call, %%Total Time in "
       "Kernels, %%Total Program Time\n");
+  if (self_time)
+    printf(
+        "          Regions: Self Time (outside nested regions and kernels), "
+        "%%Total Program Time\n");
+  if (percentiles)
+    printf("          Min, p50, p90, p99, p99.9, Max Time per Call\n");
+  if (ranks)
+    printf(
+        "          Min, Mean, Max, Std. Dev. of Total Time across Files, "
+        "Imbalance (Max/Mean - 1), Std. Dev. of Time per Call, File with "
+        "Max\n");
   printf(
       "------------------------------------------------------------------------"
       "-\n\n");
@@ -99,39 +200,8 @@ int main(int argc, char* argv[]) {
   printf("Regions: \n\n");
 
   for (unsigned int i = 0; i < kernelInfo.size(); i++) {
-    const double callCountDouble = (double)kernelInfo[i]->getCallCount();
-
     if (kernelInfo[i]->getKernelType() != REGION) continue;
-    if (fixed_width)
-      printf("- %100s\n%11s%c%15.5f%c%12" PRIu64 "%c%15.5f%c%7.3f%c%7.3f\n",
-             kernelInfo[i]->getName().c_str(),
-             (kernelInfo[i]->getKernelType() == PARALLEL_FOR)
-                 ? (" (ParFor)  ")
-                 : ((kernelInfo[i]->getKernelType() == PARALLEL_REDUCE)
-                        ? (" (ParRed)  ")
-                        : ((kernelInfo[i]->getKernelType() == PARALLEL_SCAN)
-                               ? (" (ParScan) ")
-                               : (" (Region)  "))),
-             delimiter, kernelInfo[i]->getTime(), delimiter,
-             kernelInfo[i]->getCallCount(), delimiter,
-             kernelInfo[i]->getTime() / callCountDouble, delimiter,
-             (kernelInfo[i]->getTime() / totalKernelsTime) * 100.0, delimiter,
-             (kernelInfo[i]->getTime() / totalExecuteTime) * 100.0);
-    else
-      printf("- %s\n%s%c%f%c%" PRIu64 "%c%f%c%f%c%f\n",
-             kernelInfo[i]->getName().c_str(),
-             (kernelInfo[i]->getKernelType() == PARALLEL_FOR)
-                 ? (" (ParFor)  ")
-                 : ((kernelInfo[i]->getKernelType() == PARALLEL_REDUCE)
-                        ? (" (ParRed)  ")
-                        : ((kernelInfo[i]->getKernelType() == PARALLEL_SCAN)
-                               ? (" (ParScan) ")
-                               : (" (REGION)  "))),
-             delimiter, kernelInfo[i]->getTime(), delimiter,
-             kernelInfo[i]->getCallCount(), delimiter,
-             kernelInfo[i]->getTime() / callCountDouble, delimiter,
-             (kernelInfo[i]->getTime() / totalKernelsTime) * 100.0, delimiter,
-             (kernelInfo[i]->getTime() / totalExecuteTime) * 100.0);
+    print_kernel(*kernelInfo[i]);
   }
 
   printf("\n");
@@ -141,45 +211,55 @@ int main(int argc, char* argv[]) {
   printf("Kernels: \n\n");
 
   for (unsigned int i = 0; i < kernelInfo.size(); i++) {
-    const double callCountDouble = (double)kernelInfo[i]->getCallCount();
-
-    if (kernelInfo[i]->getKernelType() == REGION) continue;
-    if (fixed_width)
-      printf("- %100s\n%11s%c%15.5f%c%12" PRIu64 "%c%15.5f%c%7.3f%c%7.3f\n",
-             kernelInfo[i]->getName().c_str(),
-             (kernelInfo[i]->getKernelType() == PARALLEL_FOR)
-                 ? (" (ParFor)  ")
-                 : ((kernelInfo[i]->getKernelType() == PARALLEL_REDUCE)
-                        ? (" (ParRed)  ")
-                        : ((kernelInfo[i]->getKernelType() == PARALLEL_SCAN)
-                               ? (" (ParScan) ")
-                               : (" (Region)  "))),
-             delimiter, kernelInfo[i]->getTime(), delimiter,
-             kernelInfo[i]->getCallCount(), delimiter,
-             kernelInfo[i]->getTime() / callCountDouble, delimiter,
-             (kernelInfo[i]->getTime() / totalKernelsTime) * 100.0, delimiter,
-             (kernelInfo[i]->getTime() / totalExecuteTime) * 100.0);
-    else
-      printf("- %s\n%s%c%f%c%" PRIu64 "%c%f%c%f%c%f\n",
-             kernelInfo[i]->getName().c_str(),
-             (kernelInfo[i]->getKernelType() == PARALLEL_FOR)
-                 ? (" (ParFor)  ")
-                 : ((kernelInfo[i]->getKernelType() == PARALLEL_REDUCE)
-                        ? (" (ParRed)  ")
-                        : ((kernelInfo[i]->getKernelType() == PARALLEL_SCAN)
-                               ? (" (ParScan) ")
-                               : (" (REGION)  "))),
-             delimiter, kernelInfo[i]->getTime(), delimiter,
-             kernelInfo[i]->getCallCount(), delimiter,
-             kernelInfo[i]->getTime() / callCountDouble, delimiter,
-             (kernelInfo[i]->getTime() / totalKernelsTime) * 100.0, delimiter,
-             (kernelInfo[i]->getTime() / totalExecuteTime) * 100.0);
+    if (kernelInfo[i]->getKernelType() == REGION ||
+        kernelInfo[i]->getKernelType() == FENCE)
+      continue;
+    print_kernel(*kernelInfo[i]);
   }
 
   printf("\n");
   printf(
       "------------------------------------------------------------------------"
       "-\n");
+
+  // Fences are only recorded when the timer runs in a fence mode.
+  if (totalFencesCalls > 0) {
+    printf("Fences: \n\n");
+
+    for (unsigned int i = 0; i < kernelInfo.size(); i++) {
+      if (kernelInfo[i]->getKernelType() != FENCE) continue;
+      print_kernel(*kernelInfo[i]);
+    }
+
+    printf("\n");
+    printf(
+        "----------------------------------------------------------------------"
+        "---\n");
+  }
+
+  // Only worth a section once kernels ran on more than one device.
+  const auto devices = sumByDevice(kernelInfo);
+  if (devices.size() > 1) {
+    printf("Devices: (Total Time, Call Count, %%Total Program Time)\n\n");
+
+    for (const auto& device : devices) {
+      if (fixed_width)
+        printf("- %-9u%c%15.5f%c%12" PRIu64 "%c%7.3f\n", device.first,
+               delimiter, device.second.time, delimiter,
+               device.second.callCount, delimiter,
+               (device.second.time / totalExecuteTime) * 100.0);
+      else
+        printf("- %u%c%f%c%" PRIu64 "%c%f\n", device.first, delimiter,
+               device.second.time, delimiter, device.second.callCount,
+               delimiter, (device.second.time / totalExecuteTime) * 100.0);
+    }
+
+    printf("\n");
+    printf(
+        "----------------------------------------------------------------------"
+        "---\n");
+  }
+
   printf("Summary:\n");
   printf("\n");
   printf(
@@ -193,9 +273,23 @@ int main(int argc, char* argv[]) {
       (totalExecuteTime - totalKernelsTime));
   printf("   -> Percentage in Kokkos kernels:                    %20.2f %%\n",
          (totalKernelsTime / totalExecuteTime) * 100);
+  if (totalFencesCalls > 0) {
+    printf(
+        "Total Time in Kokkos fences:                           %20.5f "
+        "seconds\n",
+        totalFencesTime);
+    printf(
+        "   -> Percentage in Kokkos fences:                     %20.2f %%\n",
+        (totalFencesTime / totalExecuteTime) * 100);
+  }
   printf("Total Calls to Kokkos Kernels:                         %20" PRIu64
          "\n",
          totalKernelsCalls);
+  if (totalFencesCalls > 0) {
+    printf("Total Calls to Kokkos Fences:                          %20" PRIu64
+           "\n",
+           totalFencesCalls);
+  }
   printf("\n");
   printf(
       "------------------------------------------------------------------------"
@@ -14,50 +14,114 @@
 //
 //@HEADER
 
+#include <iostream>
+
 #include "kp_shared.h"
 
 namespace KokkosTools {
 namespace KernelTimer {
 
-uint64_t uniqID = 0;
-KernelPerformanceInfo* currentEntry;
-std::map<std::string, KernelPerformanceInfo*> count_map;
-double initTime;
+std::atomic<uint64_t> uniqID = 0;
+std::map<std::pair<std::string, uint32_t>, KernelPerformanceInfo*> count_map;
+std::mutex count_map_mutex;
+thread_local KernelLookupTable kernel_table;
+KernelLaunchTable launch_table;
+uint64_t initTime;
 char* outputDelimiter;
-int current_region_level = 0;
-KernelPerformanceInfo* regions[512];
+thread_local std::vector<RegionFrame> region_stack;
+thread_local size_t region_depth = 0;
+bool region_path_keys            = false;
+thread_local std::string region_path;
+
+namespace {
+
+// Each thread has its own lookup table, so only the first launch of a
+// kernel on a given thread has to take the lock on count_map.
+auto insert_kernel(KernelExecutionType kType, uint32_t devID) {
+  return [kType, devID](std::string_view label) {
+    std::lock_guard<std::mutex> lock(count_map_mutex);
+    auto [it, inserted] =
+        count_map.emplace(std::make_pair(std::string(label), devID), nullptr);
+    if (inserted) {
+      it->second = new KernelPerformanceInfo(it->first.first, kType, devID);
+    }
+    return it->second;
+  };
+}
 
-void increment_counter(const char* name, KernelExecutionType kType) {
-  std::string nameStr(name);
+}  // namespace
 
-  if (count_map.find(name) == count_map.end()) {
-    KernelPerformanceInfo* info = new KernelPerformanceInfo(nameStr, kType);
-    count_map.insert(
-        std::pair<std::string, KernelPerformanceInfo*>(nameStr, info));
+KernelPerformanceInfo* find_or_insert_kernel(const char* name,
+                                             KernelExecutionType kType,
+                                             uint32_t devID) {
+  return kernel_table.findOrInsert(name, devID, insert_kernel(kType, devID));
+}
 
-    currentEntry = info;
+uint64_t increment_counter(const char* name, KernelExecutionType kType,
+                           uint32_t devID) {
+  KernelPerformanceInfo* info;
+  if (region_path_keys && region_depth > 0) {
+    // Path keys are built in the same buffer every time, so they are only
+    // looked up by content.
+    thread_local std::string path_key;
+    path_key.assign(region_path).append(name);
+    info = kernel_table.findOrInsertName(path_key, devID,
+                                         insert_kernel(kType, devID));
   } else {
-    currentEntry = count_map[nameStr];
+    info = find_or_insert_kernel(name, kType, devID);
   }
 
-  currentEntry->startTimer();
+  const uint64_t kID = launch_table.open(uniqID++, info, ticks(), devID);
+  if (kID == KernelLaunchTable::invalidID) {
+    static std::atomic<bool> warned = false;
+    if (!warned.exchange(true)) {
+      std::cerr << "KokkosP: WARNING: more than "
+                << KernelLaunchTable::capacity
+                << " kernels in flight, some launches are not timed\n";
+    }
+  }
+  return kID;
 }
 
-void increment_counter_region(const char* name, KernelExecutionType kType) {
-  std::string nameStr(name);
+void end_counter(uint64_t kID) {
+  const uint64_t endTicks = ticks();
 
-  if (count_map.find(name) == count_map.end()) {
-    KernelPerformanceInfo* info = new KernelPerformanceInfo(nameStr, kType);
-    count_map.insert(
-        std::pair<std::string, KernelPerformanceInfo*>(nameStr, info));
+  uint64_t startTicks         = 0;
+  KernelPerformanceInfo* info = launch_table.close(kID, startTicks);
+  if (info == nullptr) return;
 
-    regions[current_region_level] = info;
-  } else {
-    regions[current_region_level] = count_map[nameStr];
+  info->recordCall(endTicks - startTicks);
+  if (region_depth > 0) {
+    region_stack[region_depth - 1].childTicks += endTicks - startTicks;
   }
+}
+
+void increment_counter_region(const char* name, KernelExecutionType kType) {
+  if (region_depth == region_stack.size()) region_stack.emplace_back();
+
+  RegionFrame& frame = region_stack[region_depth++];
+  frame.info         = find_or_insert_kernel(name, kType, 0);
+  frame.childTicks   = 0;
+  frame.pathLength   = region_path.size();
+  if (region_path_keys) region_path.append(name).append(regionPathSeparator);
+  frame.startTicks = ticks();
+}
+
+bool decrement_counter_region() {
+  const uint64_t endTicks = ticks();
+  if (region_depth == 0) return false;
+
+  const RegionFrame& frame = region_stack[--region_depth];
+  const uint64_t inclusive = endTicks - frame.startTicks;
+  frame.info->recordCall(inclusive);
+  // Kernels on other instances may overlap, so the children can add up to
+  // more than the region itself.
+  frame.info->addSelfTicks(
+      inclusive > frame.childTicks ? inclusive - frame.childTicks : 0);
+  region_path.resize(frame.pathLength);
 
-  regions[current_region_level]->startTimer();
-  current_region_level++;
+  if (region_depth > 0) region_stack[region_depth - 1].childTicks += inclusive;
+  return true;
 }
 
 }  // namespace KernelTimer
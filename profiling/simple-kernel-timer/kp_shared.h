@@ -17,40 +17,63 @@
 #ifndef _H_KOKKOSP_KERNEL_SHARED
 #define _H_KOKKOSP_KERNEL_SHARED
 
+#include <atomic>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
 #include <vector>
 
+#include "kp_dat_format.h"
 #include "kp_kernel_info.h"
+#include "kp_kernel_table.h"
 
 namespace KokkosTools::KernelTimer {
 
-extern uint64_t uniqID;
-extern KernelPerformanceInfo* currentEntry;
-extern std::map<std::string, KernelPerformanceInfo*> count_map;
-extern double initTime;
+extern std::atomic<uint64_t> uniqID;
+// Keyed by kernel name and devID.
+extern std::map<std::pair<std::string, uint32_t>, KernelPerformanceInfo*>
+    count_map;
+extern std::mutex count_map_mutex;
+extern thread_local KernelLookupTable kernel_table;
+extern KernelLaunchTable launch_table;
+extern uint64_t initTime;
 extern char* outputDelimiter;
-extern int current_region_level;
-extern KernelPerformanceInfo* regions[512];
 
-void increment_counter(const char* name, KernelExecutionType kType);
+/// A region open on the calling thread. Kernels and nested regions that end
+/// while it is the innermost one add their duration to childTicks, which is
+/// taken off its inclusive time to get its self time.
+struct RegionFrame {
+  KernelPerformanceInfo* info = nullptr;
+  uint64_t startTicks         = 0;
+  uint64_t childTicks         = 0;
+  size_t pathLength           = 0;  // of region_path before the push
+};
+
+// Frames above region_depth have been popped; they are kept so that an
+// unbalanced pop can report the regions that were last open.
+extern thread_local std::vector<RegionFrame> region_stack;
+extern thread_local size_t region_depth;
+// Set with KOKKOS_TOOLS_TIMER_REGION_PATH: kernels are then keyed by the
+// regions they were launched in, e.g. "solve > assemble > kernel".
+extern bool region_path_keys;
+extern thread_local std::string region_path;
+
+uint64_t increment_counter(const char* name, KernelExecutionType kType,
+                           uint32_t devID);
+void end_counter(uint64_t kID);
 void increment_counter_region(const char* name, KernelExecutionType kType);
+bool decrement_counter_region();
+KernelPerformanceInfo* find_or_insert_kernel(const char* name,
+                                             KernelExecutionType kType,
+                                             uint32_t devID);
 
 inline bool compareKernelPerformanceInfo(KernelPerformanceInfo* left,
                                          KernelPerformanceInfo* right) {
   return left->getTime() > right->getTime();
 };
 
-inline int find_index(const std::vector<KernelPerformanceInfo*>& kernels,
-                      const std::string& kernelName) {
-  for (unsigned int i = 0; i < kernels.size(); ++i) {
-    if (kernels[i]->getName() == kernelName) {
-      return i;
-    }
-  }
-  return -1;
-}
-
 }  // namespace KokkosTools::KernelTimer
 
 #endif  // _H_KOKKOSP_KERNEL_SHARED
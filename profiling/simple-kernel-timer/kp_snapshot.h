@@ -0,0 +1,203 @@
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 4.0
+//       Copyright (2022) National Technology & Engineering
+//               Solutions of Sandia, LLC (NTESS).
+//
+// Under the terms of Contract DE-NA0003525 with NTESS,
+// the U.S. Government retains certain rights in this software.
+//
+// Part of Kokkos, under the Apache License v2.0 with LLVM Exceptions.
+// See https://kokkos.org/LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//@HEADER
+
+#ifndef _H_KOKKOSP_SNAPSHOT
+#define _H_KOKKOSP_SNAPSHOT
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cctype>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "kp_shared.h"
+
+namespace KokkosTools::KernelTimer {
+
+/**
+ * @brief Background thread writing what happened since the last snapshot.
+ *
+ * Every interval, the thread copies the counters of each kernel in count_map
+ * and writes the difference to the previous copy with the given writer, to
+ * <host>-<pid>.snapshot-<n>.<ext>. The counters are atomics, so the copy
+ * takes no lock that a launch could wait on; count_map_mutex is only held
+ * to list the kernels, never during I/O.
+ *
+ * The interval is either a number of seconds or, with an "l" suffix, a
+ * number of kernel launches, e.g. "60" or "100000l".
+ */
+class SnapshotThread {
+ public:
+  using Writer = std::function<bool(
+      FILE*, double, const std::vector<KernelPerformanceInfo*>&)>;
+
+  ~SnapshotThread() { stop(); }
+
+  /// Start writing snapshots as configured by @p interval. Returns false,
+  /// without starting, unless @p interval is a positive number of seconds
+  /// or a positive whole number of launches followed by "l".
+  bool start(const char* interval, const char* extension, Writer writer) {
+    if (!parseInterval(interval)) return false;
+
+    fileExtension = extension;
+    writeKernels  = std::move(writer);
+    lastTicks     = ticks();
+    lastLaunch    = uniqID;
+    stopping      = false;
+    thread        = std::thread(&SnapshotThread::run, this);
+    return true;
+  }
+
+  void stop() {
+    if (!thread.joinable()) return;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wakeUp.notify_all();
+    thread.join();
+  }
+
+  double getSeconds() const { return secondsInterval; }
+
+  uint64_t getLaunches() const { return launchInterval; }
+
+ private:
+  bool parseInterval(const char* interval) {
+    launchInterval  = 0;
+    secondsInterval = 0;
+    // strtod and strtoull take a sign, and strtod "inf" and "nan" too.
+    if (!isdigit(static_cast<unsigned char>(interval[0])) &&
+        interval[0] != '.') {
+      return false;
+    }
+    char* suffix = nullptr;
+    if (strchr(interval, 'l') != nullptr) {
+      const unsigned long long value = strtoull(interval, &suffix, 10);
+      if (strcmp(suffix, "l") == 0) launchInterval = value;
+    } else {
+      const double value = strtod(interval, &suffix);
+      if (*suffix == '\0' && std::isfinite(value)) secondsInterval = value;
+    }
+    return launchInterval > 0 || secondsInterval > 0;
+  }
+
+  void run() {
+    // Launches are only counted through uniqID, so that mode polls.
+    const auto period =
+        launchInterval != 0
+            ? std::chrono::duration<double>(0.01)
+            : std::chrono::duration<double>(secondsInterval);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping) {
+      if (wakeUp.wait_for(lock, period, [this] { return stopping; })) break;
+      if (launchInterval != 0 && uniqID - lastLaunch < launchInterval) {
+        continue;
+      }
+
+      lock.unlock();
+      write();
+      lock.lock();
+    }
+  }
+
+  void write() {
+    const uint64_t now = ticks();
+    lastLaunch         = uniqID;
+
+    std::vector<KernelPerformanceInfo*> kernels;
+    {
+      std::lock_guard<std::mutex> lock(count_map_mutex);
+      kernels.reserve(count_map.size());
+      for (const auto& kernel : count_map) kernels.push_back(kernel.second);
+    }
+
+    std::vector<std::unique_ptr<KernelPerformanceInfo>> deltas;
+    std::vector<KernelPerformanceInfo*> deltaList;
+    for (KernelPerformanceInfo* kernel : kernels) {
+      auto& previous = written[kernel];
+      if (!previous) {
+        previous = std::make_unique<KernelPerformanceInfo>(
+            kernel->getName(), kernel->getKernelType(), kernel->getDeviceID());
+      }
+
+      auto delta = std::make_unique<KernelPerformanceInfo>(
+          kernel->getName(), kernel->getKernelType(), kernel->getDeviceID());
+      delta->assignDelta(*kernel, *previous);
+      if (delta->getCallCount() == 0) continue;
+
+      previous->merge(*delta);
+      deltaList.push_back(delta.get());
+      deltas.push_back(std::move(delta));
+    }
+
+    char hostname[256];
+    gethostname(hostname, 256);
+    char fileOutput[512], fileTemp[520];
+    snprintf(fileOutput, 512, "%s-%d.snapshot-%d.%s", hostname, (int)getpid(),
+             count++, fileExtension);
+    snprintf(fileTemp, 520, "%s.tmp", fileOutput);
+
+    // Write under a temporary name so that a run killed halfway through
+    // never leaves a truncated snapshot behind.
+    FILE* output = fopen(fileTemp, "wb");
+    if (output == nullptr) {
+      fprintf(stderr, "KokkosP: ERROR: cannot open %s\n", fileTemp);
+      return;
+    }
+    const bool ok =
+        writeKernels(output, ticksToSeconds(now - lastTicks), deltaList);
+    if (fclose(output) != 0 || !ok || rename(fileTemp, fileOutput) != 0) {
+      fprintf(stderr, "KokkosP: ERROR: failed to write %s\n", fileOutput);
+      unlink(fileTemp);
+    }
+    lastTicks = now;
+  }
+
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable wakeUp;
+  bool stopping = false;
+
+  double secondsInterval    = 0;
+  uint64_t launchInterval   = 0;
+  const char* fileExtension = "dat";
+  Writer writeKernels;
+
+  // Only touched by the snapshot thread.
+  std::unordered_map<const KernelPerformanceInfo*,
+                     std::unique_ptr<KernelPerformanceInfo>>
+      written;
+  uint64_t lastTicks  = 0;
+  uint64_t lastLaunch = 0;
+  int count           = 0;
+};
+
+}  // namespace KokkosTools::KernelTimer
+
+#endif  // _H_KOKKOSP_SNAPSHOT
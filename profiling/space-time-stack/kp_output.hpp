@@ -0,0 +1,224 @@
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 4.0
+//       Copyright (2022) National Technology & Engineering
+//               Solutions of Sandia, LLC (NTESS).
+//
+// Under the terms of Contract DE-NA0003525 with NTESS,
+// the U.S. Government retains certain rights in this software.
+//
+// Part of Kokkos, under the Apache License v2.0 with LLVM Exceptions.
+// See https://kokkos.org/LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//@HEADER
+
+#ifndef KOKKOSTOOLS_SPACE_TIME_STACK_OUTPUT_HPP
+#define KOKKOSTOOLS_SPACE_TIME_STACK_OUTPUT_HPP
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace KokkosTools {
+namespace SpaceTimeStack {
+
+/// Replaces %r in an output path by the MPI rank, %p by the process id, %n
+/// by the number of a snapshot and %% by a single %.
+inline std::string expand_output_path(std::string const& path, int rank,
+                                      std::uint64_t number = 0) {
+  std::string expanded;
+  for (std::size_t i = 0; i < path.size(); ++i) {
+    if (path[i] == '%' && i + 1 < path.size()) {
+      switch (path[i + 1]) {
+        case 'r': expanded += std::to_string(rank); ++i; continue;
+        case 'n': expanded += std::to_string(number); ++i; continue;
+        case 'p': expanded += std::to_string(getpid()); ++i; continue;
+        case '%': expanded += '%'; ++i; continue;
+      }
+    }
+    expanded += path[i];
+  }
+  return expanded;
+}
+
+/**
+ * Collects JSON text in a buffer and hands it to a stream in large chunks.
+ *
+ * Numbers are formatted by hand rather than through the stream, in the
+ * notation the stream manipulators would give, since a large tree has
+ * hundreds of thousands of them. Values out of the range of the fast paths
+ * go through snprintf. Strings are escaped in a single pass. Whatever is
+ * left in the buffer is written on destruction.
+ */
+class JsonBuffer {
+ public:
+  explicit JsonBuffer(std::ostream& os_in) : os(os_in) {
+    buffer.reserve(2 * chunk_size);
+  }
+  ~JsonBuffer() { flush(); }
+  JsonBuffer& operator<<(std::string_view text) {
+    buffer.append(text);
+    return flush_if_full();
+  }
+  JsonBuffer& operator<<(char c) {
+    buffer += c;
+    return flush_if_full();
+  }
+  JsonBuffer& integer(long long value) {
+    if (value < 0) buffer += '-';
+    append_digits(value < 0 ? 0ULL - static_cast<unsigned long long>(value)
+                            : static_cast<unsigned long long>(value),
+                  1);
+    return flush_if_full();
+  }
+  /// Like std::fixed with the given precision, at most 6.
+  JsonBuffer& fixed(double value, int precision) {
+    const double scaled = std::fabs(value) * power_of_ten(precision);
+    if (!(scaled < 1e18) || near_tie(scaled)) {
+      return format("%.*f", precision, value);
+    }
+    if (std::signbit(value)) buffer += '-';
+    append_scaled(static_cast<unsigned long long>(std::nearbyint(scaled)),
+                  precision);
+    return flush_if_full();
+  }
+  /// Like std::scientific with the given precision, at most 6.
+  JsonBuffer& scientific(double value, int precision) {
+    const double magnitude = std::fabs(value);
+    if (!(magnitude < 1e300) || (magnitude != 0. && magnitude < 1e-300)) {
+      return format("%.*e", precision, value);
+    }
+    auto scaled_at = [&](int exponent) {
+      const int shift = precision - exponent;
+      return shift >= 0 ? magnitude * std::pow(10., shift)
+                        : magnitude / std::pow(10., -shift);
+    };
+
+    const double unit = power_of_ten(precision);
+    int exponent      = 0;
+    double rounded    = 0.;
+    if (magnitude != 0.) {
+      // log10 may be off by one around powers of ten
+      exponent      = int(std::floor(std::log10(magnitude)));
+      double scaled = scaled_at(exponent);
+      if (scaled < unit) {
+        scaled = scaled_at(--exponent);
+      } else if (scaled >= 10. * unit) {
+        scaled = scaled_at(++exponent);
+      }
+      if (near_tie(scaled)) return format("%.*e", precision, value);
+      rounded = std::nearbyint(scaled);
+      if (rounded >= 10. * unit) {  // 9.99 rounds to 1.00e+01
+        rounded = unit;
+        exponent++;
+      }
+    }
+    if (std::signbit(value)) buffer += '-';
+    append_scaled(static_cast<unsigned long long>(rounded), precision);
+    buffer += exponent < 0 ? "e-" : "e+";
+    append_digits(exponent < 0 ? -exponent : exponent, 2);
+    return flush_if_full();
+  }
+  JsonBuffer& general(double value, int precision) {
+    return format("%.*g", precision, value);
+  }
+  JsonBuffer& pointer(const void* value) {
+    if (value == nullptr) return *this << '0';
+    auto address = reinterpret_cast<std::uintptr_t>(value);
+    char text[2 * sizeof(address)];
+    char* first = text + sizeof(text);
+    for (; address != 0; address >>= 4) {
+      *--first = "0123456789abcdef"[address & 0xf];
+    }
+    buffer += "0x";
+    buffer.append(first, text + sizeof(text));
+    return flush_if_full();
+  }
+  /// Appends text as a JSON string, quoted and escaped.
+  JsonBuffer& string(std::string_view text) {
+    buffer += '"';
+    for (const char c : text) {
+      switch (c) {
+        case '"': buffer += "\\\""; break;
+        case '\\': buffer += "\\\\"; break;
+        case '\n': buffer += "\\n"; break;
+        case '\t': buffer += "\\t"; break;
+        default:
+          if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", unsigned(c));
+            buffer += escaped;
+          } else {
+            buffer += c;
+          }
+      }
+    }
+    buffer += '"';
+    return flush_if_full();
+  }
+  void flush() {
+    os.write(buffer.data(), std::streamsize(buffer.size()));
+    buffer.clear();
+  }
+
+ private:
+  static constexpr std::size_t chunk_size = 1 << 20;
+
+  static double power_of_ten(int exponent) {
+    static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6};
+    return powers[exponent];
+  }
+  // Whether the rounding errors in scaling a value could decide how it
+  // rounds, which snprintf does from its exact decimal expansion.
+  static bool near_tie(double scaled) {
+    return std::fabs(scaled - std::floor(scaled) - 0.5) <= scaled * 1e-15;
+  }
+  // Appends digits with a decimal point before the last precision ones.
+  void append_scaled(unsigned long long digits, int precision) {
+    const auto unit = static_cast<unsigned long long>(power_of_ten(precision));
+    append_digits(digits / unit, 1);
+    if (precision > 0) {
+      buffer += '.';
+      append_digits(digits % unit, precision);
+    }
+  }
+  // Appends value in decimal, padded with zeros to at least width digits.
+  void append_digits(unsigned long long value, int width) {
+    char text[20];
+    char* first = text + sizeof(text);
+    do {
+      *--first = char('0' + value % 10);
+      value /= 10;
+    } while (value != 0);
+    while (text + sizeof(text) - first < width) *--first = '0';
+    buffer.append(first, text + sizeof(text));
+  }
+
+  template <typename... Args>
+  JsonBuffer& format(const char* fmt, Args... args) {
+    char text[384];
+    const int length = snprintf(text, sizeof(text), fmt, args...);
+    buffer.append(text, std::min(std::size_t(length), sizeof(text) - 1));
+    return flush_if_full();
+  }
+  JsonBuffer& flush_if_full() {
+    if (buffer.size() >= chunk_size) flush();
+    return *this;
+  }
+
+  std::ostream& os;
+  std::string buffer;
+};
+
+}  // namespace SpaceTimeStack
+}  // namespace KokkosTools
+
+#endif  // KOKKOSTOOLS_SPACE_TIME_STACK_OUTPUT_HPP
@@ -13,27 +13,39 @@
 // SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
 //
 //@HEADER
+#include <atomic>
+#include <cerrno>
+#include <csignal>
 #include <cstdint>
 #include <cinttypes>
+#include <cmath>
+#include <cstdio>
 #include <iostream>
 #include <ios>
 #include <iomanip>
 #include <fstream>
 #include <cstdlib>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
 #include <set>
+#include <deque>
+#include <unordered_map>
+#include <vector>
 #include <cassert>
 #include <queue>
-#include <regex>
 #include <sstream>
+#include <thread>
 #include <sys/resource.h>
+#include <unistd.h>
 #include <algorithm>
 #include <cstring>
 
 #include "utils/demangle.hpp"
 
 #include "kp_core.hpp"
+#include "kp_output.hpp"
 
 #if USE_MPI
 #include <mpi.h>
@@ -47,6 +59,55 @@ namespace SpaceTimeStack {
 // Threshold to use for output (can be set via CLI options)
 double output_threshold = 0.1;
 
+// Additional export of the tree, and where to write it (CLI options)
+enum ExportFormat {
+  EXPORT_NONE,
+  EXPORT_FOLDED,
+  EXPORT_SPEEDSCOPE,
+  EXPORT_JSON,
+  EXPORT_NDJSON
+};
+ExportFormat export_format = EXPORT_NONE;
+std::string export_path;
+
+// Whether to also keep a histogram of the runtime of each call (CLI option)
+bool call_histograms = false;
+
+// Limits on the size of the tree, 0 for none, past which new frames are
+// folded into "[other]" nodes, and whether digit runs in names are replaced
+// by '#' (CLI options)
+std::size_t max_depth    = 0;
+std::size_t max_children = 0;
+std::size_t max_nodes    = 0;
+bool canonical_labels    = false;
+
+// Whether a report can be taken on SIGUSR1 or on a profile event named
+// snapshot_event, where it is written, and whether the profile event takes
+// it over all MPI ranks (CLI options)
+bool snapshots           = false;
+bool snapshot_collective = false;
+std::string snapshot_path;
+const char* const snapshot_event = "space-time-stack: snapshot";
+
+// How many of the heaviest nodes get the runtime of each MPI rank written
+// to a CSV file, 0 for none, and where (CLI options)
+std::size_t rank_times = 0;
+std::string rank_times_path;
+
+// Replaces every run of digits in name by a single '#'.
+std::string canonicalize(std::string const& name) {
+  std::string result;
+  result.reserve(name.size());
+  for (std::size_t i = 0; i < name.size(); ++i) {
+    if (name[i] < '0' || name[i] > '9') {
+      result += name[i];
+    } else if (i == 0 || name[i - 1] < '0' || name[i - 1] > '9') {
+      result += '#';
+    }
+  }
+  return result;
+}
+
 enum Space { SPACE_HOST, SPACE_CUDA, SPACE_HIP, SPACE_SYCL, SPACE_OMPT };
 
 enum { NSPACES = 5 };
@@ -100,9 +161,23 @@ enum StackKind {
   STACK_REDUCE,
   STACK_SCAN,
   STACK_REGION,
-  STACK_COPY
+  STACK_COPY,
+  STACK_FENCE
 };
 
+const char* get_kind_name(StackKind kind) {
+  switch (kind) {
+    case STACK_FOR: return "for";
+    case STACK_REDUCE: return "reduce";
+    case STACK_SCAN: return "scan";
+    case STACK_REGION: return "region";
+    case STACK_COPY: return "copy";
+    case STACK_FENCE: return "fence";
+  }
+  abort();
+  return nullptr;
+}
+
 void print_process_hwm(bool mpi_usable) {
   struct rusage sys_resources;
   getrusage(RUSAGE_SELF, &sys_resources);
@@ -145,37 +220,375 @@ void print_process_hwm(bool mpi_usable) {
   }
 }
 
+/**
+ * Demangled frame names, interned to small integer ids.
+ *
+ * Kokkos hands the same label pointer to the begin callbacks over and over,
+ * so labels are first looked up by address. The buffer behind an address may
+ * have been reused for another label, so such a hit is only taken if the
+ * content still matches; otherwise the label is looked up by a hash of its
+ * content. Only labels never seen before are demangled. Labels demangling
+ * to the same name share its id, as do those with canonical_labels that only
+ * differ in their numbers once demangled.
+ */
+class NameTable {
+ public:
+  NameTable() { resize(256); }
+
+  std::uint32_t intern_label(const char* label) {
+    AddressSlot& hint = address_slots[address_index(label)];
+    if (hint.label == label && hint.entry != 0 &&
+        labels[hint.entry - 1] == label) {
+      return label_ids[hint.entry - 1];
+    }
+
+    const std::string_view view(label);
+    const std::uint64_t hash = hash_label(view);
+    std::uint32_t entry      = find_label(view, hash);
+    if (entry == 0) {
+      labels.emplace_back(view);
+      auto name = demangleNameKokkos(view);
+      label_ids.push_back(
+          intern_name(canonical_labels ? canonicalize(name) : name));
+      entry = std::uint32_t(labels.size());
+      insert_label(entry, hash);  // may rehash and drop the address hints
+    }
+    address_slots[address_index(label)] = AddressSlot{label, entry};
+    return label_ids[entry - 1];
+  }
+
+  std::uint32_t intern_name(std::string const& name) {
+    auto it = name_ids.find(name);
+    if (it != name_ids.end()) return it->second;
+    names.push_back(name);
+    const auto id = std::uint32_t(names.size() - 1);
+    name_ids.emplace(names.back(), id);
+    return id;
+  }
+
+  std::string const& get_name(std::uint32_t id) const { return names[id]; }
+
+ private:
+  // Entries are 1-based indices into labels, 0 marks an empty slot.
+  struct AddressSlot {
+    const char* label   = nullptr;
+    std::uint32_t entry = 0;
+  };
+  struct LabelSlot {
+    std::uint64_t hash  = 0;
+    std::uint32_t entry = 0;
+  };
+
+  static std::uint64_t hash_label(std::string_view label) {
+    std::uint64_t hash = 0xcbf29ce484222325ULL;  // 64-bit FNV-1a
+    for (const char c : label) {
+      hash ^= static_cast<unsigned char>(c);
+      hash *= 0x100000001b3ULL;
+    }
+    return hash;
+  }
+  std::size_t address_index(const char* label) const {
+    const auto key = std::uint64_t(reinterpret_cast<std::uintptr_t>(label));
+    return ((key >> 3) * 0x9e3779b97f4a7c15ULL) >> shift;
+  }
+  std::uint32_t find_label(std::string_view label, std::uint64_t hash) const {
+    const std::size_t mask = label_slots.size() - 1;
+    for (std::size_t i = hash & mask;; i = (i + 1) & mask) {
+      const LabelSlot& slot = label_slots[i];
+      if (slot.entry == 0) return 0;
+      if (slot.hash == hash && labels[slot.entry - 1] == label) {
+        return slot.entry;
+      }
+    }
+  }
+  void insert_label(std::uint32_t entry, std::uint64_t hash) {
+    if (2 * labels.size() > label_slots.size()) {
+      resize(2 * label_slots.size());
+    }
+    const std::size_t mask = label_slots.size() - 1;
+    std::size_t i          = hash & mask;
+    while (label_slots[i].entry != 0) i = (i + 1) & mask;
+    label_slots[i] = LabelSlot{hash, entry};
+  }
+  void resize(std::size_t capacity) {
+    std::vector<LabelSlot> old_slots(capacity);
+    old_slots.swap(label_slots);
+    address_slots.assign(capacity, AddressSlot{});
+    shift = 64;
+    for (std::size_t c = capacity; c > 1; c >>= 1) shift--;
+    for (auto const& slot : old_slots) {
+      if (slot.entry != 0) insert_label(slot.entry, slot.hash);
+    }
+  }
+
+  std::vector<std::string> labels;
+  std::vector<std::uint32_t> label_ids;
+  std::deque<std::string> names;  // by id; a deque keeps the keys below valid
+  std::unordered_map<std::string_view, std::uint32_t> name_ids;
+  std::vector<AddressSlot> address_slots;
+  std::vector<LabelSlot> label_slots;
+  int shift = 64;
+};
+
+// Each thread interns into its own table, so the events of a thread never
+// wait on another one. Name ids thus only mean something on the thread that
+// made them; trees of different threads are merged by name.
+thread_local NameTable name_table;
+
+struct StackNode;
+
+/// Open-addressing index of the children of a node by (name id, kind).
+class ChildIndex {
+ public:
+  StackNode* find(std::uint32_t name_id, StackKind kind) const {
+    if (slots.empty()) return nullptr;
+    const std::uint64_t key = make_key(name_id, kind);
+    const std::size_t mask  = slots.size() - 1;
+    for (std::size_t i = hash(key) & mask;; i = (i + 1) & mask) {
+      if (slots[i].node == nullptr) return nullptr;
+      if (slots[i].key == key) return slots[i].node;
+    }
+  }
+  void insert(std::uint32_t name_id, StackKind kind, StackNode* node) {
+    if (2 * (count + 1) > slots.size()) {
+      std::vector<Slot> old_slots(slots.empty() ? 8 : 2 * slots.size());
+      old_slots.swap(slots);
+      for (auto const& slot : old_slots) {
+        if (slot.node != nullptr) place(slot);
+      }
+    }
+    place(Slot{make_key(name_id, kind), node});
+    count++;
+  }
+
+ private:
+  struct Slot {
+    std::uint64_t key = 0;
+    StackNode* node   = nullptr;
+  };
+  static std::uint64_t make_key(std::uint32_t name_id, StackKind kind) {
+    return (std::uint64_t(name_id) << 8) | std::uint64_t(kind);
+  }
+  static std::uint64_t hash(std::uint64_t key) {
+    return (key * 0x9e3779b97f4a7c15ULL) >> 32;
+  }
+  void place(Slot const& slot) {
+    const std::size_t mask = slots.size() - 1;
+    std::size_t i          = hash(slot.key) & mask;
+    while (slots[i].node != nullptr) i = (i + 1) & mask;
+    slots[i] = slot;
+  }
+
+  std::vector<Slot> slots;
+  std::size_t count = 0;
+};
+
+#if USE_MPI
+// MPI counts are ints, so messages go as their length followed by chunks of
+// at most max_message_chunk bytes. Messages between two ranks arrive in
+// order.
+constexpr std::size_t max_message_chunk = std::size_t(1) << 30;
+
+void send_message(std::vector<char> const& message, int dest, MPI_Comm comm) {
+  auto const length = std::uint64_t(message.size());
+  MPI_Send(&length, 1, MPI_UINT64_T, dest, 0, comm);
+  for (std::size_t offset = 0; offset < message.size();
+       offset += max_message_chunk) {
+    auto chunk = std::min(max_message_chunk, message.size() - offset);
+    MPI_Send(message.data() + offset, int(chunk), MPI_BYTE, dest, 0, comm);
+  }
+}
+
+std::vector<char> receive_message(int source, MPI_Comm comm) {
+  std::uint64_t length = 0;
+  MPI_Recv(&length, 1, MPI_UINT64_T, source, 0, comm, MPI_STATUS_IGNORE);
+  std::vector<char> message(length);
+  for (std::size_t offset = 0; offset < message.size();
+       offset += max_message_chunk) {
+    auto chunk = std::min(max_message_chunk, message.size() - offset);
+    MPI_Recv(message.data() + offset, int(chunk), MPI_BYTE, source, 0, comm,
+             MPI_STATUS_IGNORE);
+  }
+  return message;
+}
+
+// Hands the message of rank 0 to every rank of comm.
+void broadcast_message(std::vector<char>& message, MPI_Comm comm) {
+  auto length = std::uint64_t(message.size());
+  MPI_Bcast(&length, 1, MPI_UINT64_T, 0, comm);
+  message.resize(length);
+  for (std::size_t offset = 0; offset < message.size();
+       offset += max_message_chunk) {
+    auto chunk = std::min(max_message_chunk, message.size() - offset);
+    MPI_Bcast(message.data() + offset, int(chunk), MPI_BYTE, 0, comm);
+  }
+}
+#endif
+
+/**
+ * The runtimes of the calls of a node: their extremes, and their mean and
+ * variance accumulated with Welford's algorithm, which is stable over
+ * millions of calls. With call_histograms, also a histogram in which bin 0
+ * holds calls under a nanosecond and bin k > 0 those of 2^(k-1) up to 2^k
+ * nanoseconds.
+ */
+struct CallStats {
+  enum { NBINS = 48 };
+  std::int64_t count = 0;
+  double min         = 0.;
+  double max         = 0.;
+  double mean        = 0.;
+  double m2          = 0.;  // sum of the squared differences to the mean
+  std::vector<std::uint64_t> histogram;  // empty without call_histograms
+
+  static int get_bin(double runtime) {
+    auto nanoseconds = runtime * 1e9;
+    if (!(nanoseconds >= 1.)) return 0;
+    return std::min(std::ilogb(nanoseconds) + 1, int(NBINS) - 1);
+  }
+  void add(double runtime) {
+    if (count == 0 || runtime < min) min = runtime;
+    if (count == 0 || runtime > max) max = runtime;
+    ++count;
+    auto delta = runtime - mean;
+    mean += delta / count;
+    m2 += delta * (runtime - mean);
+    if (call_histograms) {
+      if (histogram.empty()) histogram.assign(NBINS, 0);
+      histogram[get_bin(runtime)]++;
+    }
+  }
+  // Chan et al.'s update for the union of two sets of calls
+  void merge(CallStats const& other) {
+    if (other.count == 0) return;
+    if (count == 0) {
+      min = other.min;
+      max = other.max;
+    } else {
+      min = std::min(min, other.min);
+      max = std::max(max, other.max);
+    }
+    auto total = count + other.count;
+    auto delta = other.mean - mean;
+    mean += delta * other.count / total;
+    m2 += other.m2 + delta * delta * count * other.count / total;
+    count = total;
+    if (!other.histogram.empty()) {
+      if (histogram.empty()) histogram.assign(NBINS, 0);
+      for (int bin = 0; bin < NBINS; ++bin) {
+        histogram[bin] += other.histogram[bin];
+      }
+    }
+  }
+  double stddev() const { return count != 0 ? std::sqrt(m2 / count) : 0.; }
+  /// Standard deviation over the mean, in percent.
+  double jitter() const { return mean > 0. ? stddev() / mean * 100.0 : 0.; }
+};
+
+/// A node of a StackNode tree flattened by StackNode::encode. Records name
+/// their parent by record index and their name by index into the names of
+/// the message.
+struct TreeRecord {
+  std::uint32_t parent         = 0;
+  std::uint32_t name           = 0;
+  std::uint32_t kind           = 0;
+  double total_runtime         = 0.;
+  double max_runtime           = 0.;
+  double total_kokkos_runtime  = 0.;
+  double total_fence_runtime   = 0.;
+  double total_overlap_runtime = 0.;
+  std::uint64_t total_bytes    = 0;
+  std::int64_t call_count      = 0;
+  double call_min              = 0.;
+  double call_max              = 0.;
+  double call_mean             = 0.;
+  double call_m2               = 0.;
+};
+
 struct StackNode {
   StackNode* parent;
+  std::uint32_t name_id;
   std::string name;
   StackKind kind;
   std::set<StackNode> children;
+  ChildIndex child_index;
   double total_runtime;
-  double total_kokkos_runtime;
+  double total_kokkos_runtime;   // excluding the fences below
+  double total_fence_runtime;    // blocked in fences, this node and below
+  double total_overlap_runtime;  // by which the children ran concurrently
   double max_runtime;
   double avg_runtime;
+  // Over the MPI ranks, once reduced: the runtime of this rank alone, the
+  // least runtime, the ranks with the least and the most, how many ranks
+  // fall in each tenth of [min_runtime, max_runtime] and, for the heaviest
+  // nodes, the runtime of every rank. Ranks are -1 without MPI.
+  enum { NRANK_BINS = 10 };
+  double rank_runtime;
+  double min_runtime;
+  int min_rank;
+  int max_rank;
+  std::vector<std::uint32_t> rank_histogram;
+  std::vector<double> rank_runtimes;
   std::int64_t number_of_calls;
   std::int64_t total_number_of_kernel_calls;  // Counts all kernel calls (but
                                               // not region calls) this node and
                                               // below this node in the tree
+  std::uint64_t total_bytes;  // Bytes copied, if this is a deep copy
+  CallStats call_stats;
   Now start_time;
-  StackNode(StackNode* parent_in, std::string&& name_in, StackKind kind_in)
+  // Children running right now, and since when at least one has been.
+  int open_children;
+  Now busy_start;
+  double busy_runtime;  // of the children ended since busy_start
+  StackNode(StackNode* parent_in, std::uint32_t name_id_in, StackKind kind_in)
       : parent(parent_in),
-        name(std::move(name_in)),
+        name_id(name_id_in),
+        name(name_table.get_name(name_id_in)),
         kind(kind_in),
         total_runtime(0.),
         total_kokkos_runtime(0.),
+        total_fence_runtime(0.),
+        total_overlap_runtime(0.),
+        max_runtime(0.),
+        avg_runtime(0.),
+        rank_runtime(0.),
+        min_runtime(0.),
+        min_rank(-1),
+        max_rank(-1),
         number_of_calls(0),
-        total_number_of_kernel_calls(0) {}
+        total_number_of_kernel_calls(0),
+        total_bytes(0),
+        open_children(0),
+        busy_runtime(0.) {}
+  StackNode* get_child(std::uint32_t child_name_id, StackKind child_kind) {
+    auto child = child_index.find(child_name_id, child_kind);
+    if (child) return child;
+    auto res = children.emplace(this, child_name_id, child_kind);
+    assert(res.second);
+    child = const_cast<StackNode*>(&(*(res.first)));
+    child_index.insert(child_name_id, child_kind, child);
+    return child;
+  }
   StackNode* get_child(std::string&& child_name, StackKind child_kind) {
-    StackNode candidate(this, std::move(child_name), child_kind);
-    auto it = children.find(candidate);
-    if (it == children.end()) {
-      auto res = children.emplace(std::move(candidate));
-      it       = res.first;
-      assert(res.second);
+    return get_child(name_table.intern_name(child_name), child_kind);
+  }
+  /// Effective bandwidth of a deep copy node in GB/s, over all its calls.
+  double bandwidth() const {
+    return total_runtime > 0. ? total_bytes / total_runtime * 1e-9 : 0.;
+  }
+  /* Adds the runtime and calls of other, and of its subtree, to this node.
+     Children are matched by name, so other may come from another thread.
+     Both trees must not have been adopted yet. */
+  void add(StackNode const& other) {
+    total_runtime += other.total_runtime;
+    number_of_calls += other.number_of_calls;
+    total_number_of_kernel_calls += other.total_number_of_kernel_calls;
+    total_overlap_runtime += other.total_overlap_runtime;
+    total_bytes += other.total_bytes;
+    call_stats.merge(other.call_stats);
+    for (auto& child : other.children) {
+      get_child(std::string(child.name), child.kind)->add(child);
     }
-    return const_cast<StackNode*>(&(*(it)));
   }
   bool operator<(StackNode const& other) const {
     if (kind != other.kind) {
@@ -191,6 +604,11 @@ struct StackNode {
     }
     return full_name;
   }
+  std::size_t get_depth() const {
+    std::size_t depth = 0;
+    for (auto p = this->parent; p; p = p->parent) depth++;
+    return depth;
+  }
   void begin() {
     number_of_calls++;
 
@@ -200,34 +618,62 @@ struct StackNode {
       total_number_of_kernel_calls++;
     start_time = now();
   }
-  void end(Now const& end_time) {
-    auto runtime = (end_time - start_time);
+  double end(Now const& end_time) { return end(start_time, end_time); }
+  double end(Now const& start, Now const& end_time) {
+    auto runtime = (end_time - start);
     total_runtime += runtime;
+    call_stats.add(runtime);
+    return runtime;
+  }
+  /* Children may run concurrently, when kernels on several execution space
+     instances end out of order. What they ran together beyond the time any
+     of them was running is overlapped time, so that it is counted once. */
+  void begin_child(Now const& start) {
+    if (open_children++ == 0) busy_start = start;
+  }
+  void end_child(Now const& end_time, double runtime) {
+    busy_runtime += runtime;
+    if (--open_children != 0) return;
+    total_overlap_runtime +=
+        std::max(busy_runtime - (end_time - busy_start), 0.);
+    busy_runtime = 0.;
   }
   void adopt() {
-    if (this->kind != STACK_REGION) {
-      this->total_kokkos_runtime += this->total_runtime;
-    }
     for (auto& child : this->children) {
       const_cast<StackNode&>(child).adopt();
       this->total_kokkos_runtime += child.total_kokkos_runtime;
+      this->total_fence_runtime += child.total_fence_runtime;
       this->total_number_of_kernel_calls += child.total_number_of_kernel_calls;
     }
+    this->total_kokkos_runtime =
+        std::max(this->total_kokkos_runtime - this->total_overlap_runtime, 0.);
+    // A fence is time lost waiting, not time in Kokkos, even when Kokkos
+    // fences on its own inside a kernel or a copy.
+    if (this->kind == STACK_FENCE) {
+      this->total_fence_runtime = this->total_runtime;
+    } else if (this->kind != STACK_REGION) {
+      this->total_kokkos_runtime += std::max(
+          this->total_runtime - this->total_fence_runtime,
+          0.);  // floating-point may give negative epsilon instead of zero
+    }
     assert(this->total_kokkos_runtime >= 0.);
   }
   StackNode invert() const {
-    StackNode inv_root(nullptr, "", STACK_REGION);
+    StackNode inv_root(nullptr, name_table.intern_name(""), STACK_REGION);
     std::queue<StackNode const*> q;
     q.push(this);
     while (!q.empty()) {
       auto node = q.front();
       q.pop();
-      auto self_time        = node->total_runtime;
+      auto self_time        = node->total_runtime + node->total_overlap_runtime;
       auto self_kokkos_time = node->total_kokkos_runtime;
+      auto self_fence_time  = node->total_fence_runtime;
       auto calls            = node->number_of_calls;
+      auto bytes            = node->total_bytes;
       for (auto& child : node->children) {
         self_time -= child.total_runtime;
         self_kokkos_time -= child.total_kokkos_runtime;
+        self_fence_time -= child.total_fence_runtime;
         q.push(&child);
       }
       self_time = std::max(
@@ -236,40 +682,109 @@ struct StackNode {
       self_kokkos_time = std::max(
           self_kokkos_time,
           0.);  // floating-point may give negative epsilon instead of zero
+      self_fence_time = std::max(
+          self_fence_time,
+          0.);  // floating-point may give negative epsilon instead of zero
+      // The self time of a call is its runtime, except in a region.
+      if (node->kind != STACK_REGION) {
+        inv_root.get_child(node->name_id, node->kind)
+            ->call_stats.merge(node->call_stats);
+      }
       auto inv_node = &inv_root;
       inv_node->total_runtime += self_time;
       inv_node->number_of_calls += calls;
       inv_node->total_kokkos_runtime += self_kokkos_time;
+      inv_node->total_fence_runtime += self_fence_time;
+      inv_node->total_bytes += bytes;
       for (; node; node = node->parent) {
-        std::string name = node->name;
-        inv_node         = inv_node->get_child(std::move(name), node->kind);
+        inv_node = inv_node->get_child(node->name_id, node->kind);
         inv_node->total_runtime += self_time;
         inv_node->number_of_calls += calls;
         inv_node->total_kokkos_runtime += self_kokkos_time;
+        inv_node->total_fence_runtime += self_fence_time;
+        inv_node->total_bytes += bytes;
       }
     }
     return inv_root;
   }
-  void print_recursive_json(std::ostream& os, StackNode const* parent,
-                            double tree_time) const {
-    static bool add_comma = false;
-    auto percent          = (total_runtime / tree_time) * 100.0;
+  /* Writes this node and its subtree as JSON objects, one per node. With
+     ndjson, each object is a line of its own. Otherwise, the objects are
+     the comma-separated elements of an array, with one field per line, and
+     first tells whether one has been written yet. */
+  void print_recursive_json(JsonBuffer& out, StackNode const* parent,
+                            double tree_time, bool ndjson, bool& first) const {
+    auto percent = (total_runtime / tree_time) * 100.0;
 
     if (percent < output_threshold) return;
     if (!name.empty()) {
-      if (add_comma) os << ",\n";
-      add_comma = true;
-      os << "{\n";
+      const char* sep = ndjson ? ", " : ",\n";
+      if (!ndjson && !first) out << ",\n";
+      first = false;
+      out << (ndjson ? "{" : "{\n");
       auto imbalance = (max_runtime / avg_runtime - 1.0) * 100.0;
-      os << "\"average-time\" : ";
-      os << std::scientific << std::setprecision(2);
-      os << avg_runtime << ",\n";
-      os << std::fixed << std::setprecision(1);
+      out << "\"average-time\" : ";
+      out.scientific(avg_runtime, 2) << sep;
       auto percent_kokkos = (total_kokkos_runtime / total_runtime) * 100.0;
-
-      os << "\"percent\" : " << percent << ",\n";
-      os << "\"percent-kokkos\" : " << percent_kokkos << ",\n";
-      os << "\"imbalance\" : " << imbalance << ",\n";
+      auto percent_fence  = (total_fence_runtime / total_runtime) * 100.0;
+
+      out << "\"percent\" : ";
+      out.fixed(percent, 1) << sep;
+      out << "\"percent-kokkos\" : ";
+      out.fixed(percent_kokkos, 1) << sep;
+      out << "\"percent-fence\" : ";
+      out.fixed(percent_fence, 1) << sep;
+      out << "\"imbalance\" : ";
+      out.fixed(imbalance, 1) << sep;
+      out << "\"min-time\" : ";
+      out.scientific(min_runtime, 2) << sep;
+      out << "\"max-time\" : ";
+      out.scientific(max_runtime, 2) << sep;
+      if (max_rank >= 0) {
+        out << "\"min-rank\" : ";
+        out.integer(min_rank) << sep;
+        out << "\"max-rank\" : ";
+        out.integer(max_rank) << sep;
+      } else {
+        out << "\"min-rank\" : \"N/A\"" << sep;
+        out << "\"max-rank\" : \"N/A\"" << sep;
+      }
+      if (!rank_histogram.empty()) {
+        out << "\"rank-histogram\" : [";
+        for (int bin = 0; bin < NRANK_BINS; ++bin) {
+          if (bin != 0) out << ", ";
+          out.integer(rank_histogram[bin]);
+        }
+        out << ']' << sep;
+      }
+      if (call_stats.count != 0) {
+        out << "\"call-min-time\" : ";
+        out.scientific(call_stats.min, 2) << sep;
+        out << "\"call-mean-time\" : ";
+        out.scientific(call_stats.mean, 2) << sep;
+        out << "\"call-max-time\" : ";
+        out.scientific(call_stats.max, 2) << sep;
+        out << "\"call-stddev-time\" : ";
+        out.scientific(call_stats.stddev(), 2) << sep;
+        out << "\"call-jitter\" : ";
+        out.fixed(call_stats.jitter(), 1) << sep;
+      } else {
+        out << "\"call-min-time\" : \"N/A\"" << sep;
+        out << "\"call-mean-time\" : \"N/A\"" << sep;
+        out << "\"call-max-time\" : \"N/A\"" << sep;
+        out << "\"call-stddev-time\" : \"N/A\"" << sep;
+        out << "\"call-jitter\" : \"N/A\"" << sep;
+      }
+      if (!call_stats.histogram.empty()) {
+        // Up to the last bin holding calls
+        int bins = CallStats::NBINS;
+        while (bins > 1 && call_stats.histogram[bins - 1] == 0) --bins;
+        out << "\"call-histogram\" : [";
+        for (int bin = 0; bin < bins; ++bin) {
+          if (bin != 0) out << ", ";
+          out.integer(static_cast<long long>(call_stats.histogram[bin]));
+        }
+        out << ']' << sep;
+      }
 
       // Sum over kids if we're a region
       if (kind == STACK_REGION) {
@@ -277,61 +792,75 @@ struct StackNode {
         for (auto& child : children) {
           child_runtime += child.total_runtime;
         }
-        auto remainder = (1.0 - child_runtime / total_runtime) * 100.0;
-        double kps     = total_number_of_kernel_calls / avg_runtime;
-        os << "\"remainder\" : " << remainder << ",\n";
-        os << std::scientific << std::setprecision(2);
-        os << "\"kernels-per-second\" : " << kps << ",\n";
+        child_runtime -= total_overlap_runtime;
+        auto remainder  = (1.0 - child_runtime / total_runtime) * 100.0;
+        auto overlapped = (total_overlap_runtime / total_runtime) * 100.0;
+        double kps      = total_number_of_kernel_calls / avg_runtime;
+        out << "\"remainder\" : ";
+        out.fixed(remainder, 1) << sep;
+        out << "\"percent-overlapped\" : ";
+        out.fixed(overlapped, 1) << sep;
+        out << "\"kernels-per-second\" : ";
+        out.scientific(kps, 2) << sep;
       } else {
-        os << "\"remainder\" : \"N/A\",\n";
-        os << "\"kernels-per-second\" : \"N/A\",\n";
+        out << "\"remainder\" : \"N/A\"" << sep;
+        out << "\"percent-overlapped\" : \"N/A\"" << sep;
+        out << "\"kernels-per-second\" : \"N/A\"" << sep;
       }
-      os << "\"number-of-calls\" : " << number_of_calls << ",\n";
-      auto name_escape_double_quote_twices =
-          std::regex_replace(name, std::regex("\""), "\\\"");
-      os << "\"name\" : \"" << name_escape_double_quote_twices << "\",\n";
-      os << "\"parent-id\" : \"" << parent << "\",\n";
-      os << "\"id\" : \"" << this << "\",\n";
-
-      os << "\"kernel-type\" : ";
-      switch (kind) {
-        case STACK_FOR: os << "\"for\""; break;
-        case STACK_REDUCE: os << "\"reduce\""; break;
-        case STACK_SCAN: os << "\"scan\""; break;
-        case STACK_REGION: os << "\"region\""; break;
-        case STACK_COPY: os << "\"copy\""; break;
-      };
-
-      os << "\n}";
-    }
-    if (children.empty()) return;
-    auto by_time = [](StackNode const* a, StackNode const* b) {
-      if (a->total_runtime != b->total_runtime) {
-        return a->total_runtime > b->total_runtime;
+      if (kind == STACK_COPY) {
+        out << "\"bytes\" : ";
+        out.integer(static_cast<long long>(total_bytes)) << sep;
+        out << "\"gigabytes-per-second\" : ";
+        out.fixed(bandwidth(), 2) << sep;
+      } else {
+        out << "\"bytes\" : \"N/A\"" << sep;
+        out << "\"gigabytes-per-second\" : \"N/A\"" << sep;
       }
-      return a->name < b->name;
-    };
-    std::set<StackNode const*, decltype(by_time)> children_by_time(by_time);
+      out << "\"number-of-calls\" : ";
+      out.integer(number_of_calls) << sep;
+      out << "\"name\" : ";
+      out.string(name) << sep;
+      out << "\"parent-id\" : \"";
+      out.pointer(parent) << '"' << sep;
+      out << "\"id\" : \"";
+      out.pointer(this) << '"' << sep;
+
+      out << "\"kernel-type\" : ";
+      out.string(get_kind_name(kind));
+
+      out << (ndjson ? "}\n" : "\n}");
+    }
+    std::vector<StackNode const*> children_by_time;
+    children_by_time.reserve(children.size());
     for (auto& child : children) {
-      children_by_time.insert(&child);
+      children_by_time.push_back(&child);
     }
-    auto last = children_by_time.end();
-    --last;
-    for (auto it = children_by_time.begin(); it != children_by_time.end();
-         ++it) {
-      auto child = *it;
-      child->print_recursive_json(os, this, tree_time);
+    std::sort(children_by_time.begin(), children_by_time.end(),
+              [](StackNode const* a, StackNode const* b) {
+                if (a->total_runtime != b->total_runtime) {
+                  return a->total_runtime > b->total_runtime;
+                }
+                return a->name < b->name;
+              });
+    for (auto child : children_by_time) {
+      child->print_recursive_json(out, this, tree_time, ndjson, first);
     }
   }
   void print_json(std::ostream& os) const {
-    std::ios saved_state(nullptr);
-    saved_state.copyfmt(os);
-    os << "{\n";
-    os << "\"space-time-stack-data\" : [\n";
-    print_recursive_json(os, nullptr, total_runtime);
-    os << '\n';
-    os << "]\n}\n";
-    os.copyfmt(saved_state);
+    JsonBuffer out(os);
+    out << "{\n";
+    out << "\"space-time-stack-data\" : [\n";
+    bool first = true;
+    print_recursive_json(out, nullptr, total_runtime, false, first);
+    out << '\n';
+    out << "]\n}\n";
+  }
+  /* The nodes of print_json as newline-delimited JSON: one object per line
+     and no enclosing document, so files can be concatenated or streamed. */
+  void print_ndjson(std::ostream& os) const {
+    JsonBuffer out(os);
+    bool first = true;
+    print_recursive_json(out, nullptr, total_runtime, true, first);
   }
   void print_recursive(std::ostream& os, std::string my_indent,
                        std::string const& child_indent,
@@ -346,6 +875,20 @@ struct StackNode {
       os << avg_runtime << " sec ";
       os << std::fixed << std::setprecision(1);
       auto percent_kokkos = (total_kokkos_runtime / total_runtime) * 100.0;
+      auto percent_fence  = (total_fence_runtime / total_runtime) * 100.0;
+
+      os << percent << "% " << percent_kokkos << "% " << percent_fence
+         << "% " << imbalance << "% ";
+      if (max_rank >= 0) {
+        os << max_rank << " ";
+      } else {
+        os << "------ ";
+      }
+      if (call_stats.count != 0) {
+        os << call_stats.jitter() << "% ";
+      } else {
+        os << "------ ";
+      }
 
       // Sum over kids if we're a region
       if (kind == STACK_REGION) {
@@ -353,21 +896,26 @@ struct StackNode {
         for (auto& child : children) {
           child_runtime += child.total_runtime;
         }
-        auto remainder = (1.0 - child_runtime / total_runtime) * 100.0;
-        double kps     = total_number_of_kernel_calls / avg_runtime;
-        os << percent << "% " << percent_kokkos << "% " << imbalance << "% "
-           << remainder << "% " << std::scientific << std::setprecision(2)
-           << kps << " " << number_of_calls << " " << name;
+        child_runtime -= total_overlap_runtime;
+        auto remainder  = (1.0 - child_runtime / total_runtime) * 100.0;
+        auto overlapped = (total_overlap_runtime / total_runtime) * 100.0;
+        double kps      = total_number_of_kernel_calls / avg_runtime;
+        os << remainder << "% " << overlapped << "% " << std::scientific
+           << std::setprecision(2) << kps << " " << number_of_calls << " "
+           << name;
       } else
-        os << percent << "% " << percent_kokkos << "% " << imbalance << "% "
-           << "------ " << number_of_calls << " " << name;
+        os << "------ " << number_of_calls << " " << name;
 
       switch (kind) {
         case STACK_FOR: os << " [for]"; break;
         case STACK_REDUCE: os << " [reduce]"; break;
         case STACK_SCAN: os << " [scan]"; break;
         case STACK_REGION: os << " [region]"; break;
-        case STACK_COPY: os << " [copy]"; break;
+        case STACK_COPY:
+          os << " [copy] " << std::fixed << std::setprecision(2)
+             << bandwidth() << " GB/s";
+          break;
+        case STACK_FENCE: os << " [fence]"; break;
       };
 
       os << '\n';
@@ -405,100 +953,409 @@ struct StackNode {
     os << '\n';
     os.copyfmt(saved_state);
   }
+  /* Time spent in this node outside of its children, averaged over ranks
+     like the first column of the report. Self times are taken the same way
+     as in invert(). */
+  double self_runtime() const {
+    auto self_time = avg_runtime;
+    if (total_runtime > 0.) {
+      self_time += total_overlap_runtime * (avg_runtime / total_runtime);
+    }
+    for (auto& child : children) {
+      self_time -= child.avg_runtime;
+    }
+    // floating-point may give negative epsilon instead of zero
+    return std::max(self_time, 0.);
+  }
+  void print_folded_recursive(std::ostream& os, std::string& path) const {
+    auto const parent_length = path.size();
+    if (!name.empty()) {
+      if (parent_length != 0) path += ';';
+      for (const char c : name) {
+        path += c == ';' ? ':' : (c == '\n' ? ' ' : c);
+      }
+      auto self_us = std::llround(self_runtime() * 1e6);
+      if (self_us > 0) os << path << ' ' << self_us << '\n';
+    }
+    for (auto& child : children) {
+      child.print_folded_recursive(os, path);
+    }
+    path.resize(parent_length);
+  }
+  /* Folded stacks, as read by flamegraph.pl and inferno: one line per node
+     with the frames from the root down to it joined by ';', followed by its
+     self time in microseconds. */
+  void print_folded(std::ostream& os) const {
+    std::string path;
+    print_folded_recursive(os, path);
+  }
+  /* A speedscope profile of type "sampled": one sample per node, whose
+     stack is the path from the root down to it and whose weight is its
+     self time in seconds. Frames are shared by name. */
+  void print_speedscope(std::ostream& os) const {
+    std::vector<std::uint32_t> frames;
+    std::unordered_map<std::uint32_t, std::size_t> frame_index;
+    std::vector<std::vector<std::size_t>> samples;
+    std::vector<double> weights;
+    std::vector<std::size_t> stack;
+    auto visit = [&](auto& self, StackNode const& node) -> void {
+      if (!node.name.empty()) {
+        auto res = frame_index.emplace(node.name_id, frames.size());
+        if (res.second) frames.push_back(node.name_id);
+        stack.push_back(res.first->second);
+        samples.push_back(stack);
+        weights.push_back(node.self_runtime());
+      }
+      for (auto& child : node.children) self(self, child);
+      if (!node.name.empty()) stack.pop_back();
+    };
+    visit(visit, *this);
+
+    JsonBuffer out(os);
+    out << "{\n";
+    out << "\"$schema\" : "
+           "\"https://www.speedscope.app/file-format-schema.json\",\n";
+    out << "\"exporter\" : \"kokkos-tools space-time-stack\",\n";
+    out << "\"name\" : \"space-time-stack\",\n";
+    out << "\"activeProfileIndex\" : 0,\n";
+    out << "\"shared\" : {\"frames\" : [";
+    for (std::size_t i = 0; i < frames.size(); ++i) {
+      out << (i == 0 ? "\n" : ",\n") << "{\"name\" : ";
+      out.string(name_table.get_name(frames[i])) << '}';
+    }
+    out << "\n]},\n";
+    out << "\"profiles\" : [{\n";
+    out << "\"type\" : \"sampled\",\n";
+    out << "\"name\" : \"space-time-stack\",\n";
+    out << "\"unit\" : \"seconds\",\n";
+    out << "\"startValue\" : 0,\n";
+    out << "\"endValue\" : ";
+    out.general(avg_runtime, 9) << ",\n";
+    out << "\"samples\" : [";
+    for (std::size_t i = 0; i < samples.size(); ++i) {
+      out << (i == 0 ? "\n[" : ",\n[");
+      for (std::size_t j = 0; j < samples[i].size(); ++j) {
+        if (j != 0) out << ',';
+        out.integer(static_cast<long long>(samples[i][j]));
+      }
+      out << ']';
+    }
+    out << "\n],\n";
+    out << "\"weights\" : [";
+    for (std::size_t i = 0; i < weights.size(); ++i) {
+      out << (i == 0 ? "\n" : ",\n");
+      out.general(weights[i], 9);
+    }
+    out << "\n]\n}]\n}\n";
+  }
+  /* Flattens this tree into a message for reduce_over_mpi: the record and
+     name counts, one TreeRecord per node in breadth-first order, then the
+     names the records refer to, each once, as a length and its bytes, and
+     with call_histograms, the histogram of each node in the same order. */
+  std::vector<char> encode() const {
+    std::vector<StackNode const*> nodes{this};
+    std::vector<TreeRecord> records(1);
+    std::vector<std::uint32_t> names;
+    std::unordered_map<std::uint32_t, std::uint32_t> name_index;
+    for (std::size_t i = 0; i < nodes.size(); ++i) {
+      auto node = nodes[i];
+      auto res  = name_index.emplace(node->name_id, names.size());
+      if (res.second) names.push_back(node->name_id);
+      TreeRecord& record           = records[i];
+      record.name                  = res.first->second;
+      record.kind                  = node->kind;
+      record.total_runtime         = node->total_runtime;
+      record.max_runtime           = node->max_runtime;
+      record.total_kokkos_runtime  = node->total_kokkos_runtime;
+      record.total_fence_runtime   = node->total_fence_runtime;
+      record.total_overlap_runtime = node->total_overlap_runtime;
+      record.total_bytes           = node->total_bytes;
+      record.call_count            = node->call_stats.count;
+      record.call_min              = node->call_stats.min;
+      record.call_max              = node->call_stats.max;
+      record.call_mean             = node->call_stats.mean;
+      record.call_m2               = node->call_stats.m2;
+      for (auto& child : node->children) {
+        nodes.push_back(&child);
+        records.emplace_back();
+        records.back().parent = std::uint32_t(i);
+      }
+    }
+
+    const std::uint32_t counts[2] = {std::uint32_t(records.size()),
+                                     std::uint32_t(names.size())};
+    std::vector<char> message(sizeof(counts) +
+                              records.size() * sizeof(TreeRecord));
+    memcpy(message.data(), counts, sizeof(counts));
+    memcpy(message.data() + sizeof(counts), records.data(),
+           records.size() * sizeof(TreeRecord));
+    for (auto name_id : names) {
+      auto const& name = name_table.get_name(name_id);
+      auto length      = std::uint32_t(name.size());
+      auto bytes       = reinterpret_cast<char const*>(&length);
+      message.insert(message.end(), bytes, bytes + sizeof(length));
+      message.insert(message.end(), name.begin(), name.end());
+    }
+    if (call_histograms) {
+      std::vector<std::uint64_t> bins(CallStats::NBINS);
+      for (auto node : nodes) {
+        auto const& histogram = node->call_stats.histogram;
+        std::fill(bins.begin(), bins.end(), 0);
+        std::copy(histogram.begin(), histogram.end(), bins.begin());
+        auto bytes = reinterpret_cast<char const*>(bins.data());
+        message.insert(message.end(), bytes,
+                       bytes + bins.size() * sizeof(std::uint64_t));
+      }
+    }
+    return message;
+  }
+  /* Interns the count names of a message from encode() that start at p,
+     and moves p past them. */
+  static std::vector<std::uint32_t> decode_names(char const*& p,
+                                                 std::uint32_t count) {
+    std::vector<std::uint32_t> name_ids(count);
+    for (auto& name_id : name_ids) {
+      std::uint32_t length;
+      memcpy(&length, p, sizeof(length));
+      p += sizeof(length);
+      name_id = name_table.intern_name(std::string(p, length));
+      p += length;
+    }
+    return name_ids;
+  }
+  /* Adds the tree in a message from encode() to this one, creating the
+     nodes that only exist over there. Runtimes are summed, except for
+     max_runtime, which keeps the maximum. Call counts stay those of this
+     tree, while the runtimes of the calls are those of both. */
+  void merge(std::vector<char> const& message) {
+    std::uint32_t counts[2];
+    memcpy(counts, message.data(), sizeof(counts));
+    char const* records = message.data() + sizeof(counts);
+    char const* p       = records + counts[0] * sizeof(TreeRecord);
+    auto name_ids       = decode_names(p, counts[1]);
+    std::vector<StackNode*> nodes(counts[0]);
+    for (std::uint32_t i = 0; i < counts[0]; ++i) {
+      TreeRecord record;
+      memcpy(&record, records + i * sizeof(TreeRecord), sizeof(TreeRecord));
+      auto node = i == 0 ? this
+                         : nodes[record.parent]->get_child(
+                               name_ids[record.name], StackKind(record.kind));
+      node->total_runtime += record.total_runtime;
+      node->max_runtime = std::max(node->max_runtime, record.max_runtime);
+      node->total_kokkos_runtime += record.total_kokkos_runtime;
+      node->total_fence_runtime += record.total_fence_runtime;
+      node->total_overlap_runtime += record.total_overlap_runtime;
+      node->total_bytes += record.total_bytes;
+      CallStats calls;
+      calls.count = record.call_count;
+      calls.min   = record.call_min;
+      calls.max   = record.call_max;
+      calls.mean  = record.call_mean;
+      calls.m2    = record.call_m2;
+      if (call_histograms) {
+        calls.histogram.resize(CallStats::NBINS);
+        memcpy(calls.histogram.data(),
+               p + i * CallStats::NBINS * sizeof(std::uint64_t),
+               CallStats::NBINS * sizeof(std::uint64_t));
+      }
+      node->call_stats.merge(calls);
+      nodes[i] = node;
+    }
+  }
+  /* Sums the trees of all ranks into the one of rank 0, which then holds
+     the average and maximum runtime of each node over the ranks. Ranks
+     form a binomial tree: in round k, each rank with bit k set sends what
+     it merged so far to the rank 2^k below it and drops out, so a rank
+     receives at most log2(size) messages and finalize costs the same few
+     collectives whatever the size of the tree. Other ranks keep their own
+     runtimes as average and maximum. Rank 0 then also learns where the
+     time of each node went over the ranks, through spread_over_mpi. */
   void reduce_over_mpi(bool mpi_usable) {
+    std::queue<StackNode*> q;
+    q.push(this);
+    while (!q.empty()) {
+      auto node = q.front();
+      q.pop();
+      node->max_runtime  = node->total_runtime;
+      node->avg_runtime  = node->total_runtime;
+      node->rank_runtime = node->total_runtime;
+      node->min_runtime  = node->total_runtime;
+      for (auto& child : node->children) {
+        q.push(const_cast<StackNode*>(&child));
+      }
+    }
 #if USE_MPI
-    if (mpi_usable) {
-      int rank, comm_size;
-      MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-      MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
-      std::queue<StackNode*> q;
-      std::set<std::pair<std::string, StackKind>> children_to_process;
-      q.push(this);
-      while (!q.empty()) {
-        auto node = q.front();
-        q.pop();
-        node->max_runtime = node->total_runtime;
-        node->avg_runtime = node->total_runtime;
-        MPI_Allreduce(MPI_IN_PLACE, &(node->total_runtime), 1, MPI_DOUBLE,
-                      MPI_SUM, MPI_COMM_WORLD);
-        MPI_Allreduce(MPI_IN_PLACE, &(node->max_runtime), 1, MPI_DOUBLE,
-                      MPI_MAX, MPI_COMM_WORLD);
-        MPI_Allreduce(MPI_IN_PLACE, &(node->avg_runtime), 1, MPI_DOUBLE,
-                      MPI_SUM, MPI_COMM_WORLD);
-        node->avg_runtime /= comm_size;
-        MPI_Allreduce(MPI_IN_PLACE, &(node->total_kokkos_runtime), 1,
-                      MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-        /* Not all children necessarily exist on every rank. To handle this we
-           will: 1) Build a set of the child node names on each rank. 2) Start
-           with rank 0, broadcast all of it's child names and add them to the
-              queue, removing them from the set of names to be processed.
-              If a child doesn't exist on a rank we add an empty node for it.
-           3) Do a check for the lowest rank that has any remaining unprocessed
-           children and repeat step 2 broadcasting from that rank until we
-           process all children from all ranks.
-         */
-        children_to_process.clear();
-        for (auto& child : node->children) {
-          children_to_process.emplace(child.name, child.kind);
-        }
-
-        int bcast_rank = 0;
-        do {
-          int nchildren_to_process = int(children_to_process.size());
-          MPI_Bcast(&nchildren_to_process, 1, MPI_INT, bcast_rank,
-                    MPI_COMM_WORLD);
-          if (rank == bcast_rank) {
-            for (auto& child_info : children_to_process) {
-              std::string child_name = child_info.first;
-              int kind               = child_info.second;
-              int name_len           = child_name.length();
-              MPI_Bcast(&name_len, 1, MPI_INT, bcast_rank, MPI_COMM_WORLD);
-              MPI_Bcast(&child_name[0], name_len, MPI_CHAR, bcast_rank,
-                        MPI_COMM_WORLD);
-              MPI_Bcast(&kind, 1, MPI_INT, bcast_rank, MPI_COMM_WORLD);
-              auto* child =
-                  node->get_child(std::move(child_name), StackKind(kind));
-              q.push(child);
-            }
-            children_to_process.clear();
-          } else {
-            for (int i = 0; i < nchildren_to_process; ++i) {
-              int name_len;
-              MPI_Bcast(&name_len, 1, MPI_INT, bcast_rank, MPI_COMM_WORLD);
-              std::string name(size_t(name_len), '?');
-              MPI_Bcast(&name[0], name_len, MPI_CHAR, bcast_rank,
-                        MPI_COMM_WORLD);
-              int kind;
-              MPI_Bcast(&kind, 1, MPI_INT, bcast_rank, MPI_COMM_WORLD);
-              auto child = node->get_child(std::move(name), StackKind(kind));
-              q.push(child);
-              children_to_process.erase({child->name, child->kind});
-            }
-          }
-          int local_next_bcast_rank =
-              children_to_process.empty() ? comm_size : rank;
-          MPI_Allreduce(&local_next_bcast_rank, &bcast_rank, 1, MPI_INT,
-                        MPI_MIN, MPI_COMM_WORLD);
-        } while (bcast_rank < comm_size);
+    if (!mpi_usable) return;
+    MPI_Comm comm;
+    MPI_Comm_dup(MPI_COMM_WORLD, &comm);
+    int rank, comm_size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &comm_size);
+    for (int step = 1; step < comm_size; step *= 2) {
+      if (rank & step) {
+        send_message(encode(), rank - step, comm);
+        break;
       }
-    } else
+      if (rank + step >= comm_size) continue;
+      merge(receive_message(rank + step, comm));
+    }
+    spread_over_mpi(comm);
+    MPI_Comm_free(&comm);
+    if (rank != 0) return;
+    q.push(this);
+    while (!q.empty()) {
+      auto node = q.front();
+      q.pop();
+      node->avg_runtime = node->total_runtime / comm_size;
+      for (auto& child : node->children) {
+        q.push(const_cast<StackNode*>(&child));
+      }
+    }
 #else
     (void)mpi_usable;
 #endif
-    {
-      std::queue<StackNode*> q;
-      q.push(this);
-      while (!q.empty()) {
-        auto node = q.front();
-        q.pop();
-        node->max_runtime = node->total_runtime;
-        node->avg_runtime = node->total_runtime;
-        for (auto& child : node->children) {
-          q.push(const_cast<StackNode*>(&child));
-        }
+  }
+#if USE_MPI
+  /* Rank 0 broadcasts the tree it reduced, and every rank finds its own
+     runtime of each node in it, 0 for the nodes it never entered. The
+     least and most of them, with their ranks, are then known everywhere,
+     so each rank puts itself in a bin of every node before the bins are
+     summed on rank 0. The rank_times heaviest nodes, picked the same way
+     on every rank, also gather the runtime of each rank. */
+  void spread_over_mpi(MPI_Comm comm) {
+    int rank, comm_size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &comm_size);
+    std::vector<char> message;
+    if (rank == 0) message = encode();
+    broadcast_message(message, comm);
+
+    std::uint32_t counts[2];
+    memcpy(counts, message.data(), sizeof(counts));
+    char const* records = message.data() + sizeof(counts);
+    char const* p       = records + counts[0] * sizeof(TreeRecord);
+    auto name_ids       = decode_names(p, counts[1]);
+    struct RankRuntime {
+      double runtime;
+      int rank;
+    };
+    std::vector<StackNode*> nodes(counts[0]);
+    std::vector<double> total_runtimes(counts[0]);
+    std::vector<RankRuntime> runtimes(counts[0]);
+    for (std::uint32_t i = 0; i < counts[0]; ++i) {
+      TreeRecord record;
+      memcpy(&record, records + i * sizeof(TreeRecord), sizeof(TreeRecord));
+      StackNode* node = this;
+      if (i != 0) {
+        auto parent = nodes[record.parent];
+        node        = parent ? parent->child_index.find(name_ids[record.name],
+                                                        StackKind(record.kind))
+                             : nullptr;
+      }
+      nodes[i]          = node;
+      total_runtimes[i] = record.total_runtime;
+      runtimes[i]       = {node ? node->rank_runtime : 0., rank};
+    }
+    std::vector<RankRuntime> mins(counts[0]);
+    std::vector<RankRuntime> maxs(counts[0]);
+    MPI_Allreduce(runtimes.data(), mins.data(), int(counts[0]),
+                  MPI_DOUBLE_INT, MPI_MINLOC, comm);
+    MPI_Allreduce(runtimes.data(), maxs.data(), int(counts[0]),
+                  MPI_DOUBLE_INT, MPI_MAXLOC, comm);
+    std::vector<std::uint32_t> bins(counts[0] * NRANK_BINS, 0);
+    for (std::uint32_t i = 0; i < counts[0]; ++i) {
+      auto range = maxs[i].runtime - mins[i].runtime;
+      int bin    = 0;
+      if (range > 0.) {
+        bin = std::min(int((runtimes[i].runtime - mins[i].runtime) / range *
+                           NRANK_BINS),
+                       int(NRANK_BINS) - 1);
+      }
+      bins[i * NRANK_BINS + bin] = 1;
+    }
+    std::vector<std::uint32_t> sums(rank == 0 ? bins.size() : 0);
+    MPI_Reduce(bins.data(), sums.data(), int(bins.size()), MPI_UINT32_T,
+               MPI_SUM, 0, comm);
+
+    // The root stands for the whole run, so it is not one of the heaviest.
+    std::vector<std::uint32_t> heaviest;
+    for (std::uint32_t i = 1; i < counts[0]; ++i) heaviest.push_back(i);
+    auto const top = std::min(rank_times, heaviest.size());
+    std::partial_sort(heaviest.begin(), heaviest.begin() + top,
+                      heaviest.end(), [&](std::uint32_t a, std::uint32_t b) {
+                        if (total_runtimes[a] != total_runtimes[b]) {
+                          return total_runtimes[a] > total_runtimes[b];
+                        }
+                        return a < b;
+                      });
+    heaviest.resize(top);
+    std::vector<double> mine(top);
+    for (std::size_t k = 0; k < top; ++k) {
+      mine[k] = runtimes[heaviest[k]].runtime;
+    }
+    std::vector<double> all(rank == 0 ? top * comm_size : 0);
+    if (top != 0) {
+      MPI_Gather(mine.data(), int(top), MPI_DOUBLE, all.data(), int(top),
+                 MPI_DOUBLE, 0, comm);
+    }
+    if (rank != 0) return;
+
+    for (std::uint32_t i = 0; i < counts[0]; ++i) {
+      auto node         = nodes[i];
+      node->min_runtime = mins[i].runtime;
+      node->min_rank    = mins[i].rank;
+      node->max_rank    = maxs[i].rank;
+      node->rank_histogram.assign(sums.begin() + i * NRANK_BINS,
+                                  sums.begin() + (i + 1) * NRANK_BINS);
+    }
+    for (std::size_t k = 0; k < top; ++k) {
+      auto node = nodes[heaviest[k]];
+      node->rank_runtimes.resize(comm_size);
+      for (int r = 0; r < comm_size; ++r) {
+        node->rank_runtimes[r] = all[r * top + k];
       }
     }
   }
+#endif
+  /* Rows of comma-separated values for the nodes that have the runtime of
+     every rank, heaviest first: the full name, kind, average, least and
+     most runtime with their ranks, then the runtime of each rank. */
+  void print_rank_times(std::ostream& os) const {
+    std::vector<StackNode const*> nodes;
+    std::queue<StackNode const*> q;
+    q.push(this);
+    while (!q.empty()) {
+      auto node = q.front();
+      q.pop();
+      if (!node->rank_runtimes.empty()) nodes.push_back(node);
+      for (auto& child : node->children) q.push(&child);
+    }
+    std::sort(nodes.begin(), nodes.end(),
+              [](StackNode const* a, StackNode const* b) {
+                if (a->total_runtime != b->total_runtime) {
+                  return a->total_runtime > b->total_runtime;
+                }
+                return a->get_full_name() < b->get_full_name();
+              });
+    std::size_t const comm_size =
+        nodes.empty() ? 0 : nodes.front()->rank_runtimes.size();
+    os << "name,type,average-time,min-time,min-rank,max-time,max-rank";
+    for (std::size_t r = 0; r < comm_size; ++r) os << ",rank " << r;
+    os << '\n';
+    os << std::scientific << std::setprecision(6);
+    for (auto node : nodes) {
+      os << '"';
+      for (const char c : node->get_full_name()) {
+        if (c == '"') os << '"';
+        os << c;
+      }
+      os << "\"," << get_kind_name(node->kind) << ',' << node->avg_runtime
+         << ',' << node->min_runtime << ',' << node->min_rank << ','
+         << node->max_runtime << ',' << node->max_rank;
+      for (auto runtime : node->rank_runtimes) os << ',' << runtime;
+      os << '\n';
+    }
+  }
 };
 
 struct Allocation {
@@ -634,15 +1491,306 @@ struct Allocations {
   }
 };
 
-struct State {
+/**
+ * Live allocations of a space, and what was allocated at its high water mark.
+ *
+ * Copying the live set at every new peak makes each allocation
+ * O(live allocations) while memory grows. Instead, allocations and
+ * deallocations are appended to a log starting from the set in base, the
+ * peak is kept as a position in the log, and the set at the peak is only
+ * rebuilt when asked for. Once the log is longer than twice the live set, it
+ * is folded into a new base, which bounds its length and keeps the amortized
+ * cost of an event O(1).
+ */
+struct AllocationLog {
+  struct Event {
+    bool is_allocation;
+    Allocation allocation;
+  };
+  struct KeyHash {
+    std::size_t operator()(
+        std::pair<const void*, std::uint64_t> const& key) const {
+      return std::hash<const void*>()(key.first) ^
+             std::hash<std::uint64_t>()(key.second * 0x9e3779b97f4a7c15ULL);
+    }
+  };
+
+  std::uint64_t total_size = 0;
+  std::unordered_map<std::pair<const void*, std::uint64_t>, Allocation, KeyHash>
+      live;
+  Allocations base;
+  std::vector<Event> events;
+  std::uint64_t hwm_size = 0;
+  std::size_t hwm_events = 0;  // length of the log at the peak
+  bool hwm_in_log        = false;
+  Allocations hwm;  // the peak, once it has been folded out of the log
+
+  void allocate(std::string&& name, const void* ptr, std::uint64_t size,
+                StackNode* frame) {
+    Allocation allocation(std::move(name), ptr, size, frame);
+    auto res = live.emplace(std::make_pair(ptr, size), allocation);
+    assert(res.second);
+    total_size += size;
+    events.push_back(Event{true, std::move(allocation)});
+    if (total_size > hwm_size) {
+      hwm_size   = total_size;
+      hwm_events = events.size();
+      hwm_in_log = true;
+    }
+    fold_if_long();
+  }
+  void deallocate(std::string&& name, const void* ptr, std::uint64_t size,
+                  StackNode* frame) {
+    auto it = live.find(std::make_pair(ptr, size));
+    if (it == live.end()) {
+      std::stringstream ss;
+      ss << "WARNING! allocation(\"" << name << "\", " << ptr << ", " << size
+         << "), deallocated at \"" << frame->get_full_name() << "\", "
+         << " was not in the currently allocated set!\n";
+      auto s = ss.str();
+      std::cerr << s;
+      return;
+    }
+    total_size -= size;
+    live.erase(it);
+    events.push_back(
+        Event{false, Allocation(std::move(name), ptr, size, frame)});
+    fold_if_long();
+  }
+  Allocations get_hwm() const {
+    return hwm_in_log ? replay(hwm_events) : hwm;
+  }
+
+ private:
+  Allocations replay(std::size_t nevents) const {
+    Allocations result = base;
+    for (std::size_t i = 0; i < nevents; ++i) {
+      auto const& a = events[i].allocation;
+      if (events[i].is_allocation) {
+        result.allocate(std::string(a.name), a.ptr, a.size, a.frame);
+      } else {
+        result.deallocate(std::string(a.name), a.ptr, a.size, a.frame);
+      }
+    }
+    return result;
+  }
+  void fold_if_long() {
+    if (events.size() < 1024 || events.size() < 2 * live.size()) return;
+    if (hwm_in_log) {
+      hwm        = replay(hwm_events);
+      hwm_in_log = false;
+    }
+    base = Allocations();
+    for (auto const& entry : live) {
+      auto const& a = entry.second;
+      base.allocate(std::string(a.name), a.ptr, a.size, a.frame);
+    }
+    events.clear();
+  }
+};
+
+/**
+ * Deep copies from each space to each space, binned by size: bin 0 holds
+ * the empty copies and bin k > 0 those of 2^(k-1) up to 2^k - 1 bytes.
+ */
+struct CopyStats {
+  enum { NBINS = 65 };
+  std::uint64_t copies[NSPACES][NSPACES][NBINS] = {};
+  std::uint64_t bytes[NSPACES][NSPACES][NBINS]  = {};
+  double seconds[NSPACES][NSPACES][NBINS]       = {};
+
+  static int get_bin(std::uint64_t size) {
+    int bin = 0;
+    for (; size != 0; size >>= 1) bin++;
+    return bin;
+  }
+  void add(Space src, Space dst, std::uint64_t size, double runtime) {
+    auto bin = get_bin(size);
+    copies[src][dst][bin]++;
+    bytes[src][dst][bin] += size;
+    seconds[src][dst][bin] += runtime;
+  }
+  void merge(CopyStats const& other) {
+    for (int src = 0; src < NSPACES; ++src) {
+      for (int dst = 0; dst < NSPACES; ++dst) {
+        for (int bin = 0; bin < NBINS; ++bin) {
+          copies[src][dst][bin] += other.copies[src][dst][bin];
+          bytes[src][dst][bin] += other.bytes[src][dst][bin];
+          seconds[src][dst][bin] += other.seconds[src][dst][bin];
+        }
+      }
+    }
+  }
+  /// Sums the copies of all ranks into rank 0.
+  void reduce_over_mpi(bool mpi_usable) {
+#if USE_MPI
+    if (!mpi_usable) return;
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    const int count = NSPACES * NSPACES * NBINS;
+    MPI_Reduce(rank == 0 ? MPI_IN_PLACE : &copies[0][0][0], &copies[0][0][0],
+               count, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(rank == 0 ? MPI_IN_PLACE : &bytes[0][0][0], &bytes[0][0][0],
+               count, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(rank == 0 ? MPI_IN_PLACE : &seconds[0][0][0], &seconds[0][0][0],
+               count, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+#else
+    (void)mpi_usable;
+#endif
+  }
+  static void print_figures(std::ostream& os, std::uint64_t n,
+                            std::uint64_t b, double t) {
+    os << n << ' ' << std::fixed << std::setprecision(1) << b / 1024.0
+       << " kB " << std::scientific << std::setprecision(2) << t << " sec "
+       << std::fixed << std::setprecision(2) << (t > 0. ? b / t * 1e-9 : 0.)
+       << " GB/s\n";
+  }
+  // Names 2^exponent bytes.
+  static std::string size_name(int exponent) {
+    static const char* units[] = {"B", "kB", "MB", "GB", "TB", "PB", "EB"};
+    return std::to_string(1 << (exponent % 10)) + ' ' + units[exponent / 10];
+  }
+  /// Prints the copies between each pair of spaces, if there were any.
+  void print(std::ostream& os) const {
+    std::ios saved_state(nullptr);
+    saved_state.copyfmt(os);
+    bool first = true;
+    for (int src = 0; src < NSPACES; ++src) {
+      for (int dst = 0; dst < NSPACES; ++dst) {
+        std::uint64_t total_copies = 0;
+        std::uint64_t total_bytes  = 0;
+        double total_seconds       = 0.;
+        for (int bin = 0; bin < NBINS; ++bin) {
+          total_copies += copies[src][dst][bin];
+          total_bytes += bytes[src][dst][bin];
+          total_seconds += seconds[src][dst][bin];
+        }
+        if (total_copies == 0) continue;
+        if (first) {
+          os << "DEEP COPIES:\n";
+          os << "<source space> -> <destination space> <number of copies> "
+                "<total size> <total time> <bandwidth>\n";
+          os << "    [<range of copy sizes>) <number of copies> <total size> "
+                "<total time> <bandwidth>\n";
+          os << "===================\n";
+          first = false;
+        }
+        os << get_space_name(src) << " -> " << get_space_name(dst) << ' ';
+        print_figures(os, total_copies, total_bytes, total_seconds);
+        for (int bin = 0; bin < NBINS; ++bin) {
+          if (copies[src][dst][bin] == 0) continue;
+          if (bin == 0) {
+            os << "    [0 B, 1 B) ";
+          } else {
+            os << "    [" << size_name(bin - 1) << ", " << size_name(bin)
+               << ") ";
+          }
+          print_figures(os, copies[src][dst][bin], bytes[src][dst][bin],
+                        seconds[src][dst][bin]);
+        }
+      }
+    }
+    if (!first) os << '\n';
+    os.copyfmt(saved_state);
+  }
+};
+
+/// The frames of one host thread and the tree they build. Only that thread
+/// touches it until finalize, so kernels and regions take no locks.
+struct ThreadStack {
+  // A deep copy that has begun and not ended yet.
+  struct PendingCopy {
+    Space src;
+    Space dst;
+    std::uint64_t size;
+  };
+
+  // A kernel that has begun and not ended yet. Kernels are not frames, as
+  // those on execution space instances may end in any order.
+  struct OpenKernel {
+    std::uint64_t kernid;
+    StackNode* node;
+    StackNode* frame;  // on top of the stack when it began
+    Now start_time;
+  };
+
+  // An allocation or deallocation, numbered in the order of all threads.
+  struct AllocationEvent {
+    std::uint64_t sequence;
+    Space space;
+    AllocationLog::Event event;
+  };
+
   StackNode stack_root;
   StackNode* stack_frame;
-  Allocations current_allocations[NSPACES];
-  Allocations hwm_allocations[NSPACES];
-  State() : stack_root(nullptr, "", STACK_REGION), stack_frame(&stack_root) {
+  int index;  // in the order threads sent their first event
+  std::vector<OpenKernel> open_kernels;  // mostly ending last to first
+  std::uint64_t last_kernid = 0;
+  int folded_frames = 0;  // begun inside the "[other]" frame on top
+  // Held while the thread logs an allocation and, with snapshots, while it
+  // changes its tree, which another thread may then read.
+  std::mutex mutex;
+  std::vector<PendingCopy> pending_copies;
+  CopyStats copy_stats;
+  std::vector<AllocationEvent> allocation_events;  // not merged yet
+  explicit ThreadStack(int index_in)
+      : stack_root(nullptr, name_table.intern_name(""), STACK_REGION),
+        stack_frame(&stack_root),
+        index(index_in) {
     stack_frame->begin();
   }
+};
+
+// Where SIGUSR1 asks for a snapshot, or -1. Only written outside the handler.
+std::atomic<int> snapshot_signal_fd{-1};
+
+void snapshot_signal_handler(int) {
+  int const saved_errno = errno;
+  char const request    = 's';
+  int const fd          = snapshot_signal_fd;
+  if (fd >= 0) (void)!write(fd, &request, 1);
+  errno = saved_errno;
+}
+
+// The stack of the calling thread, valid while generation matches the one
+// of the live State.
+struct ThreadSlot {
+  ThreadStack* stack       = nullptr;
+  std::uint64_t generation = 0;
+};
+thread_local ThreadSlot this_thread;
+std::uint64_t state_generation = 0;
+
+struct State {
+  Now start_time;
+  std::uint64_t generation;
+  std::mutex threads_mutex;
+  std::vector<std::unique_ptr<ThreadStack>> threads;
+  // Each thread logs its allocations, numbered from allocation_sequence.
+  // The high water mark needs one order of all of them, so the logs are
+  // merged into current_allocations at snapshots, at the end, and whenever
+  // a log grows to max_logged_allocations, which bounds their length.
+  // current_allocations is only changed with threads_mutex held.
+  static constexpr std::size_t max_logged_allocations = 1024;
+  std::atomic<std::uint64_t> allocation_sequence{0};
+  AllocationLog current_allocations[NSPACES];
+  // Nodes made by the threads, against max_nodes
+  std::atomic<std::size_t> number_of_nodes{0};
+  std::atomic<bool> limits_reached{false};
+  // The MPI rank, once a thread has seen MPI initialized. Snapshots that
+  // are not collective do not call MPI, and use it to name their files.
+  bool rank_known = false;
+  int known_rank  = 0;
+  // Snapshots are taken one at a time. Those asked for by SIGUSR1 are taken
+  // by snapshot_thread, which reads the requests from a pipe.
+  std::mutex snapshot_mutex;
+  std::uint64_t number_of_snapshots = 0;
+  int snapshot_pipe[2]              = {-1, -1};
+  std::thread snapshot_thread;
+  struct sigaction previous_action;
+  State() : start_time(now()), generation(++state_generation) {}
   ~State() {
+    stop_snapshots();
     bool mpi_usable = false;
 #if USE_MPI
     int mpi_initialized;
@@ -650,34 +1798,60 @@ struct State {
     if (static_cast<bool>(mpi_initialized)) mpi_usable = true;
 #endif
     auto end_time = now();
-    if (stack_frame != &stack_root) {
-      std::cerr << "Program ended before \"" << stack_frame->get_full_name()
-                << "\" ended\n";
-      abort();
+    StackNode stack_root(nullptr, name_table.intern_name(""), STACK_REGION);
+    stack_root.number_of_calls = 1;
+    stack_root.start_time      = start_time;
+    stack_root.end(end_time);
+    CopyStats copy_stats;
+    std::vector<ThreadStack::AllocationEvent> allocation_events;
+    for (auto& thread : threads) {
+      if (thread->stack_frame != &thread->stack_root) {
+        std::cerr << "Program ended before \""
+                  << thread->stack_frame->get_full_name() << "\" ended\n";
+        abort();
+      }
+      if (!thread->open_kernels.empty()) {
+        std::cerr << "Program ended before \""
+                  << thread->open_kernels.back().node->get_full_name()
+                  << "\" ended\n";
+        abort();
+      }
+      thread->stack_root.end(end_time);
+      copy_stats.merge(thread->copy_stats);
+      take_allocations(*thread, allocation_sequence, allocation_events);
+      add_thread_tree(stack_root, thread->stack_root, thread->index);
     }
-    stack_frame->end(end_time);
     stack_root.adopt();
-    stack_root.reduce_over_mpi(mpi_usable);
-    if (getenv("KOKKOS_PROFILE_EXPORT_JSON")) {
+    replay_allocations(allocation_events);
+    int rank = 0;
 #if USE_MPI
-      if (mpi_usable) {
-        int rank;
-        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-        if (rank == 0) {
-          std::ofstream fout("noname.json");
-          stack_root.print_json(fout);
-        }
-      } else
+    if (mpi_usable) MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 #endif
-      {
+    // With %r in its path, every rank exports its own tree before the
+    // reduction. Otherwise rank 0 exports the reduced one.
+    bool const export_per_rank = export_path.find("%r") != std::string::npos;
+    if (export_format != EXPORT_NONE && export_per_rank) {
+      stack_root.reduce_over_mpi(false);
+      export_tree(stack_root, rank);
+    }
+    stack_root.reduce_over_mpi(mpi_usable);
+    if (export_format != EXPORT_NONE && !export_per_rank && rank == 0) {
+      export_tree(stack_root, rank);
+    }
+    if (rank_times != 0 && mpi_usable && rank == 0) {
+      write_rank_times(stack_root, rank);
+    }
+    if (getenv("KOKKOS_PROFILE_EXPORT_JSON")) {
+      if (rank == 0) {
         std::ofstream fout("noname.json");
         stack_root.print_json(fout);
       }
       return;
     }
 
+    // Inverted from the reduced tree, so there is nothing left to reduce.
     auto inv_stack_root = stack_root.invert();
-    inv_stack_root.reduce_over_mpi(mpi_usable);
+    inv_stack_root.reduce_over_mpi(false);
 
 #if USE_MPI
     if (mpi_usable) {
@@ -686,26 +1860,17 @@ struct State {
       if (rank == 0) {
         std::cout << "\nBEGIN KOKKOS PROFILING REPORT:\n";
         std::cout << "TOTAL TIME: " << stack_root.max_runtime << " seconds\n";
-        std::cout << "TOP-DOWN TIME TREE:\n";
-        std::cout << "<average time> <percent of total time> <percent time in "
-                     "Kokkos> <percent MPI imbalance> <remainder> <kernels per "
-                     "second> <number of calls> <name> [type]\n";
-        std::cout << "=================== \n";
-        stack_root.print(std::cout);
-        std::cout << "BOTTOM-UP TIME TREE:\n";
-        std::cout << "<average time> <percent of total time> <percent time in "
-                     "Kokkos> <percent MPI imbalance> <number of calls> <name> "
-                     "[type]\n";
-        std::cout << "=================== \n";
-        inv_stack_root.print(std::cout);
+        print_trees(std::cout, stack_root, inv_stack_root);
       }
+      copy_stats.reduce_over_mpi(mpi_usable);
+      if (rank == 0) copy_stats.print(std::cout);
       for (int space = 0; space < NSPACES; ++space) {
         if (rank == 0) {
           std::cout << "KOKKOS " << get_space_name(space) << " SPACE:\n";
           std::cout << "=================== \n";
           std::cout.flush();
         }
-        hwm_allocations[space].print(std::cout, mpi_usable);
+        current_allocations[space].get_hwm().print(std::cout, mpi_usable);
       }
       print_process_hwm(mpi_usable);
       if (rank == 0) {
@@ -717,24 +1882,14 @@ struct State {
     {
       std::cout << "\nBEGIN KOKKOS PROFILING REPORT:\n";
       std::cout << "TOTAL TIME: " << stack_root.max_runtime << " seconds\n";
-      std::cout << "TOP-DOWN TIME TREE:\n";
-      std::cout << "<average time> <percent of total time> <percent time in "
-                   "Kokkos> <percent MPI imbalance> <remainder> <kernels per "
-                   "second> <number of calls> <name> [type]\n";
-      std::cout << "===================\n";
-      stack_root.print(std::cout);
-      std::cout << "BOTTOM-UP TIME TREE:\n";
-      std::cout
-          << "<average time> <percent of total time> <percent time in Kokkos> "
-             "<percent MPI imbalance> <number of calls> <name> [type]\n";
-      std::cout << "===================\n";
-      inv_stack_root.print(std::cout);
+      print_trees(std::cout, stack_root, inv_stack_root);
+      copy_stats.print(std::cout);
 
       for (int space = 0; space < NSPACES; ++space) {
         std::cout << "KOKKOS " << get_space_name(space) << " SPACE:\n";
         std::cout << "===================\n";
         std::cout.flush();
-        hwm_allocations[space].print(std::cout, mpi_usable);
+        current_allocations[space].get_hwm().print(std::cout, mpi_usable);
       }
       print_process_hwm(mpi_usable);
       std::cout << "END KOKKOS PROFILING REPORT.\n";
@@ -742,48 +1897,399 @@ struct State {
     }
   }
 
-  void begin_frame(const char* name, StackKind kind) {
-    std::string name_str(demangleNameKokkos(name));
-    stack_frame = stack_frame->get_child(std::move(name_str), kind);
-    stack_frame->begin();
+  // Threads are summed into one tree, or kept apart as its top nodes.
+  static void add_thread_tree(StackNode& stack_root,
+                              StackNode const& thread_root, int index) {
+    if (getenv("KOKKOS_PROFILE_THREAD_ROOTS")) {
+      stack_root.get_child("thread " + std::to_string(index), STACK_REGION)
+          ->add(thread_root);
+    } else {
+      stack_root.total_overlap_runtime += thread_root.total_overlap_runtime;
+      for (auto& child : thread_root.children) {
+        stack_root.get_child(std::string(child.name), child.kind)->add(child);
+      }
+    }
+  }
+
+  static void print_trees(std::ostream& os, StackNode const& stack_root,
+                          StackNode const& inv_stack_root) {
+    os << "TOP-DOWN TIME TREE:\n";
+    os << "<average time> <percent of total time> <percent time in Kokkos> "
+          "<percent time in fences> <percent MPI imbalance> <slowest "
+          "rank> <per-call jitter> <remainder> <percent overlapped> "
+          "<kernels per second> <number of calls> <name> [type]\n";
+    os << "===================\n";
+    stack_root.print(os);
+    os << "BOTTOM-UP TIME TREE:\n";
+    os << "<average time> <percent of total time> <percent time in Kokkos> "
+          "<percent time in fences> <percent MPI imbalance> <slowest "
+          "rank> <per-call jitter> <number of calls> <name> [type]\n";
+    os << "===================\n";
+    inv_stack_root.print(os);
+  }
+
+  /* Moves the allocations that thread logged before sequence number end to
+     events, merged with those already there by sequence number. */
+  static void take_allocations(
+      ThreadStack& thread, std::uint64_t end,
+      std::vector<ThreadStack::AllocationEvent>& events) {
+    using Event = ThreadStack::AllocationEvent;
+    auto& log   = thread.allocation_events;
+    auto last   = std::find_if(log.begin(), log.end(), [=](Event const& e) {
+      return e.sequence >= end;
+    });
+    auto middle = events.size();
+    events.insert(events.end(), std::make_move_iterator(log.begin()),
+                  std::make_move_iterator(last));
+    log.erase(log.begin(), last);
+    std::inplace_merge(events.begin(), events.begin() + middle, events.end(),
+                       [](Event const& a, Event const& b) {
+                         return a.sequence < b.sequence;
+                       });
+  }
+  void replay_allocations(std::vector<ThreadStack::AllocationEvent>& events) {
+    for (auto& e : events) {
+      auto& a = e.event.allocation;
+      if (e.event.is_allocation) {
+        current_allocations[e.space].allocate(std::move(a.name), a.ptr, a.size,
+                                              a.frame);
+      } else {
+        current_allocations[e.space].deallocate(std::move(a.name), a.ptr,
+                                                a.size, a.frame);
+      }
+    }
+  }
+  // Called with threads_mutex held, like snapshot, so that the events are
+  // replayed in the order they were numbered.
+  void merge_allocations() {
+    auto const allocations_end = allocation_sequence.load();
+    std::vector<ThreadStack::AllocationEvent> allocation_events;
+    for (auto& thread : threads) {
+      std::lock_guard<std::mutex> lock(thread->mutex);
+      take_allocations(*thread, allocations_end, allocation_events);
+    }
+    replay_allocations(allocation_events);
+  }
+
+  // The node of copy at the path of node in the tree copy was added from
+  static StackNode* find_copy(StackNode& copy, StackNode const* node) {
+    if (!node->parent) return &copy;
+    return find_copy(copy, node->parent)
+        ->get_child(std::string(node->name), node->kind);
+  }
+
+  /* Writes the report as it stands now to a numbered file, without ending
+     anything: frames and kernels still open count up to now. The trees of
+     the threads are copied under their locks, so they can go on while the
+     copy is reported. Only a collective snapshot uses MPI, and it must
+     then be taken on all ranks. */
+  void snapshot(bool collective) {
+    std::lock_guard<std::mutex> snapshot_lock(snapshot_mutex);
+    auto const number = ++number_of_snapshots;
+    StackNode stack_root(nullptr, name_table.intern_name(""), STACK_REGION);
+    stack_root.number_of_calls = 1;
+    stack_root.start_time      = start_time;
+    CopyStats copy_stats;
+    std::vector<ThreadStack::AllocationEvent> allocation_events;
+    Allocations hwm[NSPACES];
+    int local_rank;
+    {
+      std::lock_guard<std::mutex> threads_lock(threads_mutex);
+      local_rank = known_rank;
+      // A thread logs an allocation under its lock as it numbers it, so
+      // all those numbered before this are logged once the lock is taken.
+      auto const allocations_end = allocation_sequence.load();
+      for (auto& thread : threads) {
+        std::lock_guard<std::mutex> lock(thread->mutex);
+        // After the lock, so that no frame of the copy ended later
+        auto end_time = now();
+        StackNode copy(nullptr, name_table.intern_name(""), STACK_REGION);
+        copy.add(thread->stack_root);
+        copy.total_runtime += end_time - thread->stack_root.start_time;
+        for (auto frame = thread->stack_frame; frame->parent;
+             frame      = frame->parent) {
+          find_copy(copy, frame)->total_runtime += end_time - frame->start_time;
+        }
+        for (auto& kernel : thread->open_kernels) {
+          find_copy(copy, kernel.node)->total_runtime +=
+              end_time - kernel.start_time;
+        }
+        copy_stats.merge(thread->copy_stats);
+        take_allocations(*thread, allocations_end, allocation_events);
+        add_thread_tree(stack_root, copy, thread->index);
+      }
+      replay_allocations(allocation_events);
+      for (int space = 0; space < NSPACES; ++space) {
+        hwm[space] = current_allocations[space].get_hwm();
+      }
+    }
+    stack_root.end(now());
+    stack_root.adopt();
+
+    bool mpi_usable = false;
+    int rank        = 0;
+#if USE_MPI
+    if (collective) {
+      int mpi_initialized;
+      MPI_Initialized(&mpi_initialized);
+      mpi_usable = static_cast<bool>(mpi_initialized);
+      if (mpi_usable) MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    }
+#else
+    (void)collective;
+#endif
+    stack_root.reduce_over_mpi(mpi_usable);
+    auto inv_stack_root = stack_root.invert();
+    inv_stack_root.reduce_over_mpi(false);
+    copy_stats.reduce_over_mpi(mpi_usable);
+
+    // Built on every rank, as the memory report takes part in collectives
+    std::ostringstream report;
+    report << "BEGIN KOKKOS PROFILING SNAPSHOT " << number << ":\n";
+    report << "TOTAL TIME: " << stack_root.max_runtime << " seconds\n";
+    print_trees(report, stack_root, inv_stack_root);
+    copy_stats.print(report);
+    for (int space = 0; space < NSPACES; ++space) {
+      report << "KOKKOS " << get_space_name(space) << " SPACE:\n";
+      report << "===================\n";
+      hwm[space].print(report, mpi_usable);
+    }
+    report << "END KOKKOS PROFILING SNAPSHOT.\n";
+    if (rank != 0) return;
+
+    auto path = expand_output_path(
+        snapshot_path.empty() ? "noname.%p.%n.snapshot" : snapshot_path,
+        collective ? rank : local_rank, number);
+    std::ofstream fout(path);
+    if (!fout) {
+      std::cerr << "KokkosP: could not open \"" << path << "\" for writing\n";
+      return;
+    }
+    fout << report.str();
+  }
+
+  void start_snapshots() {
+    if (snapshot_thread.joinable()) return;
+    if (pipe(snapshot_pipe) != 0) {
+      std::cerr << "KokkosP: could not create a pipe for snapshots\n";
+      return;
+    }
+    snapshot_thread = std::thread([this] {
+      char request;
+      for (;;) {
+        auto n = read(snapshot_pipe[0], &request, 1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n != 1 || request != 's') break;
+        snapshot(false);
+      }
+    });
+    snapshot_signal_fd = snapshot_pipe[1];
+    struct sigaction action = {};
+    action.sa_handler       = snapshot_signal_handler;
+    action.sa_flags         = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGUSR1, &action, &previous_action);
+  }
+  void stop_snapshots() {
+    if (!snapshot_thread.joinable()) return;
+    sigaction(SIGUSR1, &previous_action, nullptr);
+    snapshot_signal_fd = -1;
+    char const request = 'q';
+    (void)!write(snapshot_pipe[1], &request, 1);
+    snapshot_thread.join();
+    close(snapshot_pipe[0]);
+    close(snapshot_pipe[1]);
+  }
+
+  void export_tree(StackNode const& stack_root, int rank) {
+    std::string path = export_path;
+    if (path.empty()) {
+      switch (export_format) {
+        case EXPORT_FOLDED: path = "noname.folded"; break;
+        case EXPORT_SPEEDSCOPE: path = "noname.speedscope.json"; break;
+        case EXPORT_JSON: path = "noname.json"; break;
+        case EXPORT_NDJSON: path = "noname.ndjson"; break;
+        case EXPORT_NONE: return;
+      }
+    }
+    path = expand_output_path(path, rank);
+    std::ofstream fout(path);
+    if (!fout) {
+      std::cerr << "KokkosP: could not open \"" << path << "\" for writing\n";
+      return;
+    }
+    switch (export_format) {
+      case EXPORT_FOLDED: stack_root.print_folded(fout); break;
+      case EXPORT_SPEEDSCOPE: stack_root.print_speedscope(fout); break;
+      case EXPORT_JSON: stack_root.print_json(fout); break;
+      case EXPORT_NDJSON: stack_root.print_ndjson(fout); break;
+      case EXPORT_NONE: break;
+    }
   }
-  void end_frame(Now end_time) {
-    stack_frame->end(end_time);
-    stack_frame = stack_frame->parent;
+  void write_rank_times(StackNode const& stack_root, int rank) {
+    auto path = expand_output_path(
+        rank_times_path.empty() ? "noname.ranks.csv" : rank_times_path, rank);
+    std::ofstream fout(path);
+    if (!fout) {
+      std::cerr << "KokkosP: could not open \"" << path << "\" for writing\n";
+      return;
+    }
+    stack_root.print_rank_times(fout);
+  }
+  ThreadStack& thread_stack() {
+    if (this_thread.generation != generation) add_thread();
+    return *this_thread.stack;
+  }
+  void add_thread() {
+    std::lock_guard<std::mutex> lock(threads_mutex);
+    threads.push_back(std::make_unique<ThreadStack>(int(threads.size())));
+    this_thread.stack      = threads.back().get();
+    this_thread.generation = generation;
+    learn_rank();
+  }
+  // Called with threads_mutex held, on the first event of each thread and
+  // on profile events, as MPI may be initialized after the library.
+  void learn_rank() {
+#if USE_MPI
+    if (rank_known) return;
+    int mpi_initialized;
+    MPI_Initialized(&mpi_initialized);
+    if (!mpi_initialized) return;
+    MPI_Comm_rank(MPI_COMM_WORLD, &known_rank);
+    rank_known = true;
+#endif
+  }
+  void profile_event() {
+    std::lock_guard<std::mutex> lock(threads_mutex);
+    learn_rank();
+  }
+  /* The child of parent that a frame or kernel is recorded in. Once the
+     tree is past one of its limits, new children of each kind are folded
+     into an "[other]" child, and into parent itself when it is such a
+     node already, so that recursion does not go deeper. */
+  StackNode* get_child(StackNode* parent, std::uint32_t name_id,
+                       StackKind kind) {
+    auto child = parent->child_index.find(name_id, kind);
+    if (child) return child;
+    bool const over_limits =
+        (max_nodes != 0 && number_of_nodes >= max_nodes) ||
+        (max_children != 0 && parent->children.size() >= max_children) ||
+        (max_depth != 0 && parent->get_depth() >= max_depth);
+    if (!over_limits) {
+      number_of_nodes++;
+      return parent->get_child(name_id, kind);
+    }
+    if (!limits_reached.exchange(true)) {
+      std::cerr << "KokkosP: WARNING: space-time-stack reached its limits, "
+                   "folding new frames into [other]\n";
+    }
+    auto other_id = name_table.intern_name("[other]");
+    if (parent->name_id == other_id && parent->kind == kind) return parent;
+    return parent->get_child(other_id, kind);
+  }
+  // With snapshots, the tree of a thread may be read by another one.
+  static std::unique_lock<std::mutex> lock_stack(ThreadStack& stack) {
+    if (!snapshots) return std::unique_lock<std::mutex>();
+    return std::unique_lock<std::mutex>(stack.mutex);
+  }
+  void begin_frame(ThreadStack& stack, const char* name, StackKind kind) {
+    auto parent = stack.stack_frame;
+    auto child  = get_child(parent, name_table.intern_label(name), kind);
+    if (child == parent) {
+      stack.folded_frames++;
+      return;
+    }
+    stack.stack_frame = child;
+    child->begin();
+    parent->begin_child(child->start_time);
+  }
+  void end_frame(ThreadStack& stack, Now end_time) {
+    if (stack.folded_frames != 0) {
+      stack.folded_frames--;
+      return;
+    }
+    auto runtime      = stack.stack_frame->end(end_time);
+    stack.stack_frame = stack.stack_frame->parent;
+    stack.stack_frame->end_child(end_time, runtime);
   }
+  /* Kernels hang under the frame that was current when they began, and
+     are looked up by ID when they end. A fence that Kokkos issues while a
+     kernel of that frame runs, as a reduction into a result the device
+     cannot access does, hangs under the innermost such kernel instead, so
+     that it is not counted as running beside it. Fences are not nested in
+     fences. */
   std::uint64_t begin_kernel(const char* name, StackKind kind) {
-    begin_frame(name, kind);
-    return reinterpret_cast<std::uint64_t>(stack_frame);
+    auto& stack = thread_stack();
+    auto lock   = lock_stack(stack);
+    auto frame  = stack.stack_frame;
+    auto parent = frame;
+    auto& open  = stack.open_kernels;
+    if (kind == STACK_FENCE && !open.empty() && open.back().frame == frame &&
+        open.back().node->kind != STACK_FENCE) {
+      parent = open.back().node;
+    }
+    auto node = get_child(parent, name_table.intern_label(name), kind);
+    node->begin();
+    parent->begin_child(node->start_time);
+    auto kernid = ++stack.last_kernid;
+    open.push_back({kernid, node, frame, node->start_time});
+    return kernid;
   }
   void end_kernel(std::uint64_t kernid) {
-    auto end_time    = now();
-    auto expect_node = reinterpret_cast<StackNode*>(kernid);
-    if (expect_node != stack_frame) {
-      std::cerr << "Expected \"" << stack_frame->get_full_name()
-                << "\" to end, got different kernel ID\n";
+    auto end_time = now();
+    auto& stack   = thread_stack();
+    auto lock     = lock_stack(stack);
+    auto& open    = stack.open_kernels;
+    auto it       = std::find_if(
+        open.rbegin(), open.rend(),
+        [=](ThreadStack::OpenKernel const& k) { return k.kernid == kernid; });
+    if (it == open.rend()) {
+      std::cerr << "Kernel ID " << kernid << " ended but was not running\n";
       abort();
     }
-    end_frame(end_time);
+    auto node    = it->node;
+    auto runtime = node->end(it->start_time, end_time);
+    node->parent->end_child(end_time, runtime);
+    open.erase(std::next(it).base());
+  }
+  void push_region(const char* name) {
+    auto& stack = thread_stack();
+    auto lock   = lock_stack(stack);
+    begin_frame(stack, name, STACK_REGION);
+  }
+  void pop_region() {
+    auto end_time = now();
+    auto& stack   = thread_stack();
+    auto lock     = lock_stack(stack);
+    end_frame(stack, end_time);
+  }
+  void log_allocation(Space space, bool is_allocation, const char* name,
+                      const void* ptr, std::uint64_t size) {
+    auto& stack = thread_stack();
+    bool full;
+    {
+      std::lock_guard<std::mutex> lock(stack.mutex);
+      stack.allocation_events.push_back(
+          {allocation_sequence++, space,
+           {is_allocation, Allocation(name, ptr, size, stack.stack_frame)}});
+      full = stack.allocation_events.size() >= max_logged_allocations;
+    }
+    if (full) {
+      std::lock_guard<std::mutex> lock(threads_mutex);
+      merge_allocations();
+    }
   }
-  void push_region(const char* name) { begin_frame(name, STACK_REGION); }
-  void pop_region() { end_frame(now()); }
   void allocate(Space space, const char* name, const void* ptr,
                 std::uint64_t size) {
-    current_allocations[space].allocate(std::string(name), ptr, size,
-                                        stack_frame);
-    if (current_allocations[space].total_size >
-        hwm_allocations[space].total_size) {
-      hwm_allocations[space] = current_allocations[space];
-    }
+    log_allocation(space, true, name, ptr, size);
   }
   void deallocate(Space space, const char* name, const void* ptr,
                   std::uint64_t size) {
-    current_allocations[space].deallocate(std::string(name), ptr, size,
-                                          stack_frame);
+    log_allocation(space, false, name, ptr, size);
   }
   void begin_deep_copy(Space dst_space, const char* dst_name, const void*,
                        Space src_space, const char* src_name, const void*,
-                       std::uint64_t) {
+                       std::uint64_t size) {
     std::string frame_name;
     frame_name += "\"";
     frame_name += dst_name;
@@ -794,9 +2300,24 @@ struct State {
     frame_name += "->";
     frame_name += get_space_name(src_space);
     frame_name += ")";
-    begin_frame(frame_name.c_str(), STACK_COPY);
+    auto& stack = thread_stack();
+    auto lock   = lock_stack(stack);
+    begin_frame(stack, frame_name.c_str(), STACK_COPY);
+    stack.stack_frame->total_bytes += size;
+    stack.pending_copies.push_back({src_space, dst_space, size});
+  }
+  void end_deep_copy() {
+    auto end_time = now();
+    auto& stack   = thread_stack();
+    auto lock     = lock_stack(stack);
+    if (!stack.pending_copies.empty()) {
+      auto copy = stack.pending_copies.back();
+      stack.pending_copies.pop_back();
+      stack.copy_stats.add(copy.src, copy.dst, copy.size,
+                           end_time - stack.stack_frame->start_time);
+    }
+    end_frame(stack, end_time);
   }
-  void end_deep_copy() { end_frame(now()); }
 };
 
 State* global_state = nullptr;
@@ -805,6 +2326,7 @@ void kokkosp_init_library(int /* loadseq */, uint64_t /* interfaceVer */,
                           uint32_t /* ndevinfos */,
                           Kokkos_Profiling_KokkosPDeviceInfo* /* devinfos */) {
   global_state = new State();
+  if (snapshots) global_state->start_snapshots();
 }
 
 void kokkosp_finalize_library() {
@@ -842,6 +2364,16 @@ void kokkosp_end_parallel_scan(std::uint64_t kernid) {
   global_state->end_kernel(kernid);
 }
 
+void kokkosp_begin_fence(const char* name, std::uint32_t devid,
+                         std::uint64_t* handle) {
+  (void)devid;
+  *handle = global_state->begin_kernel(name, STACK_FENCE);
+}
+
+void kokkosp_end_fence(std::uint64_t handle) {
+  global_state->end_kernel(handle);
+}
+
 void kokkosp_push_profile_region(const char* name) {
   global_state->push_region(name);
 }
@@ -872,6 +2404,14 @@ void kokkosp_begin_deep_copy(SpaceHandle dst_handle, const char* dst_name,
 
 void kokkosp_end_deep_copy() { global_state->end_deep_copy(); }
 
+void kokkosp_profile_event(const char* name) {
+  if (!snapshots) return;
+  global_state->profile_event();
+  if (strcmp(name, snapshot_event) == 0) {
+    global_state->snapshot(snapshot_collective);
+  }
+}
+
 Kokkos::Tools::Experimental::EventSet get_event_set() {
   Kokkos::Tools::Experimental::EventSet my_event_set;
   memset(&my_event_set, 0,
@@ -890,6 +2430,9 @@ Kokkos::Tools::Experimental::EventSet get_event_set() {
   my_event_set.end_parallel_for      = kokkosp_end_parallel_for;
   my_event_set.end_parallel_reduce   = kokkosp_end_parallel_reduce;
   my_event_set.end_parallel_scan     = kokkosp_end_parallel_scan;
+  my_event_set.begin_fence           = kokkosp_begin_fence;
+  my_event_set.end_fence             = kokkosp_end_fence;
+  my_event_set.profile_event         = kokkosp_profile_event;
   return my_event_set;
 }
 
@@ -903,27 +2446,123 @@ Description:
   Timers below this threshold will not be output.  Set to 0 to get unfiltered
   reports.
 
+Options:
+  --export=<format>  Also write the top-down tree as:
+                       folded      self times as folded stacks, for
+                                   flamegraph.pl and inferno, unfiltered
+                       speedscope  self times as a speedscope profile,
+                                   unfiltered
+                       json        the nodes above the threshold, like
+                                   KOKKOS_PROFILE_EXPORT_JSON
+                       ndjson      the same nodes, one JSON object per line
+  --output=<path>    Where to write the export. Defaults to noname.folded,
+                     noname.speedscope.json, noname.json or noname.ndjson.
+                     %p is replaced by the process id and %r by the MPI rank.
+                     With %r, every rank writes its own tree; otherwise rank
+                     0 writes the tree reduced over all ranks.
+  --call-histograms  Also count the calls of each node by runtime, in bins
+                     from 2^(k-1) to 2^k nanoseconds, and add them to the
+                     json and ndjson exports as "call-histogram".
+  --max-depth=<n>    Fold frames nested deeper than n into "[other]" nodes.
+  --max-children=<n> Fold the frames and kernels beyond the first n
+                     children of a node into "[other]" nodes.
+  --max-nodes=<n>    Fold new frames and kernels into "[other]" nodes once
+                     the tree has n nodes.
+  --canonical-labels Replace every run of digits in a label with '#', so
+                     that labels with loop or time step numbers share a node.
+  --snapshots        Write the report so far, without ending anything, on
+                     SIGUSR1 or on a profile event named
+                     "space-time-stack: snapshot". Each rank writes its own.
+  --snapshot-collective
+                     The same, but profile events, which must then happen on
+                     all ranks, write the report reduced over the ranks.
+  --snapshot-output=<path>
+                     Where to write snapshots. Defaults to
+                     noname.%p.%n.snapshot, where %n is the number of the
+                     snapshot; %p and %r are as for --output.
+  --rank-times=<k>   With MPI, also write the runtime of every rank in the
+                     k heaviest nodes of the reduced tree as CSV, one row
+                     per node.
+  --rank-times-output=<path>
+                     Where to write them. Defaults to noname.ranks.csv;
+                     %p is as for --output.
+
 Example:
   The following example would set the threshold to 10%
     <exe> [--kokkos-tools-args 10 ]
+  The following example would also write flame graph input to stack.folded
+    <exe> [--kokkos-tools-args "10 --export=folded --output=stack.folded" ]
 )usage";
-  std::cout << "usage: " << exe << "[--kokkos-tools-args <threshold>]\n"
+  std::cout << "usage: " << exe
+            << "[--kokkos-tools-args \"<threshold> [--export=<format>] "
+               "[--output=<path>] [--call-histograms] [--max-depth=<n>] "
+               "[--max-children=<n>] [--max-nodes=<n>] "
+               "[--canonical-labels] [--snapshots] [--snapshot-collective] "
+               "[--snapshot-output=<path>] [--rank-times=<k>] "
+               "[--rank-times-output=<path>]\"]\n"
             << usage;
 }
 
 void kokkosp_parse_args(int argc, char** argv) {
   // See description in original PR.
   // argc will always be at least 1 (exe)
-  if (argc == 1) {
-    // No argument, use the default
-  } else if (argc == 2) {
-    // User specified a threshold
-    output_threshold = strtod(argv[1], 0);
-  } else {
-    // Too many args
+  bool has_threshold = false;
+  bool has_output    = false;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg(argv[i]);
+    if (arg.substr(0, 9) == "--export=") {
+      if (arg.substr(9) == "folded") {
+        export_format = EXPORT_FOLDED;
+      } else if (arg.substr(9) == "speedscope") {
+        export_format = EXPORT_SPEEDSCOPE;
+      } else if (arg.substr(9) == "json") {
+        export_format = EXPORT_JSON;
+      } else if (arg.substr(9) == "ndjson") {
+        export_format = EXPORT_NDJSON;
+      } else {
+        kokkosp_print_help(argv[0]);
+        exit(1);
+      }
+    } else if (arg == "--call-histograms") {
+      call_histograms = true;
+    } else if (arg.substr(0, 12) == "--max-depth=") {
+      max_depth = strtoull(argv[i] + 12, nullptr, 10);
+    } else if (arg.substr(0, 15) == "--max-children=") {
+      max_children = strtoull(argv[i] + 15, nullptr, 10);
+    } else if (arg.substr(0, 12) == "--max-nodes=") {
+      max_nodes = strtoull(argv[i] + 12, nullptr, 10);
+    } else if (arg == "--canonical-labels") {
+      canonical_labels = true;
+    } else if (arg == "--snapshots") {
+      snapshots = true;
+    } else if (arg == "--snapshot-collective") {
+      snapshots           = true;
+      snapshot_collective = true;
+    } else if (arg.substr(0, 18) == "--snapshot-output=") {
+      snapshot_path = arg.substr(18);
+    } else if (arg.substr(0, 13) == "--rank-times=") {
+      rank_times = strtoull(argv[i] + 13, nullptr, 10);
+    } else if (arg.substr(0, 20) == "--rank-times-output=") {
+      rank_times_path = arg.substr(20);
+    } else if (arg.substr(0, 9) == "--output=") {
+      export_path = arg.substr(9);
+      has_output  = true;
+    } else if (!has_threshold) {
+      // User specified a threshold
+      output_threshold = strtod(argv[i], 0);
+      has_threshold    = true;
+    } else {
+      // Too many args
+      kokkosp_print_help(argv[0]);
+      exit(1);
+    }
+  }
+  if (has_output && export_format == EXPORT_NONE) {
+    // An output without anything to write to it
     kokkosp_print_help(argv[0]);
     exit(1);
   }
+  if (snapshots && global_state) global_state->start_snapshots();
 }
 };  // extern C
 
@@ -946,5 +2585,10 @@ EXPOSE_BEGIN_PARALLEL_SCAN(impl::kokkosp_begin_parallel_scan)
 EXPOSE_END_PARALLEL_SCAN(impl::kokkosp_end_parallel_scan)
 EXPOSE_BEGIN_PARALLEL_REDUCE(impl::kokkosp_begin_parallel_reduce)
 EXPOSE_END_PARALLEL_REDUCE(impl::kokkosp_end_parallel_reduce)
+EXPOSE_BEGIN_DEEP_COPY(impl::kokkosp_begin_deep_copy)
+EXPOSE_END_DEEP_COPY(impl::kokkosp_end_deep_copy)
+EXPOSE_BEGIN_FENCE(impl::kokkosp_begin_fence)
+EXPOSE_END_FENCE(impl::kokkosp_end_fence)
+EXPOSE_PROFILE_EVENT(impl::kokkosp_profile_event)
 
 }  // extern "C"
@@ -0,0 +1,213 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "kp_dat_format.h"
+
+using namespace KokkosTools::KernelTimer;
+
+namespace {
+
+struct Record {
+  std::string name;
+  KernelExecutionType kernelType;
+  uint64_t callCount;
+  uint64_t timeNs;
+  uint32_t deviceID;
+  uint64_t histogramTotal;
+};
+
+std::vector<Record> readRecords(const DatFile& file) {
+  std::vector<Record> records;
+  file.forEachRecord([&](const DatRecordView& view) {
+    uint64_t histogramTotal = 0;
+    for (uint32_t i = 0; i < view.bucketCount; i++) {
+      histogramTotal += view.buckets[i].count;
+    }
+    records.push_back(Record{std::string(view.name), view.kernelType,
+                             view.callCount, view.timeNs, view.deviceID,
+                             histogramTotal});
+  });
+  return records;
+}
+
+}  // namespace
+
+/**
+ * @test This test checks that kernels encoded in the v2 format read back
+ *       the same, from a buffer and from a file.
+ */
+TEST(KernelTimerTest, datFormatRoundTrip) {
+  KernelPerformanceInfo first("first kernel", PARALLEL_FOR, 1);
+  first.recordCall(nanosecondsToTicks(1000));
+  first.recordCall(nanosecondsToTicks(3000));
+  KernelPerformanceInfo second("second kernel", PARALLEL_REDUCE, 2);
+  second.recordCall(nanosecondsToTicks(500000));
+  const std::vector<KernelPerformanceInfo*> kernels{&first, &second};
+
+  const std::vector<char> image = encodeDatFile(2.5, kernels);
+
+  DatFile file;
+  std::string error;
+  ASSERT_TRUE(file.openBuffer("image", image.data(), image.size(), error))
+      << error;
+  EXPECT_EQ(file.getVersion(), datVersion);
+  EXPECT_EQ(file.getTotalExecuteTime(), 2.5);
+  EXPECT_EQ(file.getRankCount(), 1u);
+
+  const std::vector<Record> records = readRecords(file);
+  ASSERT_EQ(records.size(), 2u);
+  EXPECT_EQ(records[0].name, "first kernel");
+  EXPECT_EQ(records[0].kernelType, PARALLEL_FOR);
+  EXPECT_EQ(records[0].callCount, 2u);
+  EXPECT_EQ(records[0].timeNs, 4000u);
+  EXPECT_EQ(records[0].deviceID, 1u);
+  EXPECT_EQ(records[0].histogramTotal, 2u);
+  EXPECT_EQ(records[1].name, "second kernel");
+  EXPECT_EQ(records[1].kernelType, PARALLEL_REDUCE);
+  EXPECT_EQ(records[1].callCount, 1u);
+  EXPECT_EQ(records[1].timeNs, 500000u);
+  EXPECT_EQ(records[1].deviceID, 2u);
+  EXPECT_EQ(records[1].histogramTotal, 1u);
+
+  char path[] = "test_dat_format_XXXXXX";
+  const int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  FILE* output = fdopen(fd, "wb");
+  ASSERT_NE(output, nullptr);
+  EXPECT_TRUE(writeDatFile(output, 2.5, kernels));
+  fclose(output);
+
+  DatFile written;
+  ASSERT_TRUE(written.open(path, error)) << error;
+  EXPECT_EQ(written.getTotalExecuteTime(), 2.5);
+  const std::vector<Record> fromFile = readRecords(written);
+  ASSERT_EQ(fromFile.size(), records.size());
+  for (size_t i = 0; i < records.size(); i++) {
+    EXPECT_EQ(fromFile[i].name, records[i].name);
+    EXPECT_EQ(fromFile[i].callCount, records[i].callCount);
+    EXPECT_EQ(fromFile[i].timeNs, records[i].timeNs);
+  }
+  written.close();
+  remove(path);
+}
+
+/**
+ * @test This test checks that a header whose sections would only fit in the
+ *       file once their sizes wrap around is rejected.
+ */
+TEST(KernelTimerTest, datFormatRejectsOverflowingHeader) {
+  KernelPerformanceInfo kernel("kernel", PARALLEL_FOR);
+  kernel.recordCall(nanosecondsToTicks(1000));
+  const std::vector<KernelPerformanceInfo*> kernels{&kernel};
+  const std::vector<char> image = encodeDatFile(1.0, kernels);
+
+  DatFileHeader header;
+  memcpy(&header, image.data(), sizeof(header));
+
+  // recordCount * recordSize wraps around to a small number
+  std::vector<char> corrupt = image;
+  DatFileHeader wrapped     = header;
+  wrapped.recordSize        = 1u << 31;
+  wrapped.recordCount       = uint64_t(1) << 33;
+  memcpy(corrupt.data(), &wrapped, sizeof(wrapped));
+  DatFile file;
+  std::string error;
+  EXPECT_FALSE(file.openBuffer("corrupt", corrupt.data(), corrupt.size(),
+                               error));
+
+  // stringsOffset + stringsSize wraps around to a small number
+  corrupt               = image;
+  wrapped               = header;
+  wrapped.stringsOffset = 8;
+  wrapped.stringsSize   = ~uint64_t(0);
+  memcpy(corrupt.data(), &wrapped, sizeof(wrapped));
+  EXPECT_FALSE(file.openBuffer("corrupt", corrupt.data(), corrupt.size(),
+                               error));
+
+  // The original still opens
+  EXPECT_TRUE(file.openBuffer("image", image.data(), image.size(), error))
+      << error;
+}
+
+/**
+ * @test This test checks that a file of a later format version than the
+ *       reader knows is rejected rather than read as empty.
+ */
+TEST(KernelTimerTest, datFormatRejectsNewerVersion) {
+  KernelPerformanceInfo kernel("kernel", PARALLEL_FOR);
+  kernel.recordCall(nanosecondsToTicks(1000));
+  const std::vector<KernelPerformanceInfo*> kernels{&kernel};
+  std::vector<char> image = encodeDatFile(1.0, kernels);
+
+  DatFileHeader header;
+  memcpy(&header, image.data(), sizeof(header));
+  header.version = datVersion + 1;
+  memcpy(image.data(), &header, sizeof(header));
+
+  DatFile file;
+  std::string error;
+  EXPECT_FALSE(file.openBuffer("newer", image.data(), image.size(), error));
+  EXPECT_NE(error.find("version"), std::string::npos) << error;
+}
+
+/**
+ * @test This test checks that version 1 records whose fields run past their
+ *       length are rejected, and that the records before them are read.
+ */
+TEST(KernelTimerTest, datFormatRejectsCorruptV1Record) {
+  KernelPerformanceInfo first("first kernel", PARALLEL_FOR);
+  first.recordCall(nanosecondsToTicks(1000));
+  KernelPerformanceInfo second("second kernel", PARALLEL_REDUCE);
+  second.recordCall(nanosecondsToTicks(2000));
+
+  char* buffer      = nullptr;
+  size_t bufferSize = 0;
+  FILE* output      = open_memstream(&buffer, &bufferSize);
+  ASSERT_NE(output, nullptr);
+  const double totalTime = 1.0;
+  fwrite(&totalTime, sizeof(totalTime), 1, output);
+  first.writeToBinaryFile(output);
+  const long secondOffset = ftell(output);
+  second.writeToBinaryFile(output);
+  fclose(output);
+  const std::vector<char> image(buffer, buffer + bufferSize);
+  free(buffer);
+
+  DatFile file;
+  std::string error;
+  ASSERT_TRUE(file.openBuffer("v1", image.data(), image.size(), error))
+      << error;
+  EXPECT_EQ(file.getVersion(), 1u);
+  ASSERT_EQ(readRecords(file).size(), 2u);
+
+  // A name length past the end of the record
+  std::vector<char> corrupt = image;
+  const uint32_t nameLength = 1u << 30;
+  memcpy(corrupt.data() + secondOffset + sizeof(uint32_t), &nameLength,
+         sizeof(nameLength));
+  ASSERT_TRUE(file.openBuffer("v1", corrupt.data(), corrupt.size(), error))
+      << error;
+  std::vector<Record> records = readRecords(file);
+  ASSERT_EQ(records.size(), 1u);
+  EXPECT_EQ(records[0].name, "first kernel");
+
+  // A record too short for its fixed fields
+  corrupt                 = image;
+  const uint32_t shortLen = sizeof(uint32_t) + 2;
+  memcpy(corrupt.data() + secondOffset, &shortLen, sizeof(shortLen));
+  ASSERT_TRUE(file.openBuffer("v1", corrupt.data(), corrupt.size(), error))
+      << error;
+  EXPECT_EQ(readRecords(file).size(), 1u);
+
+  // A record longer than the rest of the file
+  corrupt                = image;
+  const uint32_t longLen = 1u << 30;
+  memcpy(corrupt.data() + secondOffset, &longLen, sizeof(longLen));
+  ASSERT_TRUE(file.openBuffer("v1", corrupt.data(), corrupt.size(), error))
+      << error;
+  EXPECT_EQ(readRecords(file).size(), 1u);
+}
@@ -40,14 +40,16 @@ struct Tester {
 static const std::vector<std::string> matchers{
     /// A kernel with a given name appears with the given name, no matter
     /// if a tag was given.
-    "[0-9.e]+ sec [0-9.]+% 100.0% 0.0% ------ 1 named kernel \\[for\\]",
-    "[0-9.e]+ sec [0-9.]+% 100.0% 0.0% ------ 1 named kernel with tag "
+    "[0-9.e]+ sec [0-9.]+% 100.0% 0.0% 0.0% ------ 0.0% ------ 1 named kernel "
     "\\[for\\]",
+    "[0-9.e]+ sec [0-9.]+% 100.0% 0.0% 0.0% ------ 0.0% ------ 1 named kernel "
+    "with tag \\[for\\]",
     //! A kernel with no name and no tag appears with a demangled name.
-    "[0-9.e]+ sec [0-9.]+% 100.0% 0.0% ------ 1 Tester \\[for\\]\n",
+    "[0-9.e]+ sec [0-9.]+% 100.0% 0.0% 0.0% ------ 0.0% ------ 1 Tester "
+    "\\[for\\]\n",
     //! A kernel with no name and a tag appears with a demangled name.
-    "[0-9.e]+ sec [0-9.]+% 100.0% 0.0% ------ 1 Tester/Tester::TagUnnamed "
-    "\\[for\\]"};
+    "[0-9.e]+ sec [0-9.]+% 100.0% 0.0% 0.0% ------ 0.0% ------ 1 "
+    "Tester/Tester::TagUnnamed \\[for\\]"};
 
 /**
  * @test This test checks that the tool effectively uses
@@ -0,0 +1,101 @@
+#include <unistd.h>
+
+#include <cstdio>
+#include <sstream>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "kp_output.hpp"
+
+using KokkosTools::SpaceTimeStack::expand_output_path;
+using KokkosTools::SpaceTimeStack::JsonBuffer;
+
+namespace {
+
+// Values that round up or down at the last printed digit, and the
+// extremes the fast paths hand over to snprintf.
+const double values[] = {9.995,  0.05,    1e-300, -0.0,    0.0,  0.125,
+                         -2.5,   0.15,    1.005,  9.99999, 1e17, 123456.789,
+                         1e-310, 4.35e-8, 1e300,  -7.5e-5};
+
+template <typename Write>
+std::string written(Write write) {
+  std::ostringstream os;
+  {
+    JsonBuffer out(os);
+    write(out);
+  }
+  return os.str();
+}
+
+std::string printed(const char* fmt, int precision, double value) {
+  char text[384];
+  snprintf(text, sizeof(text), fmt, precision, value);
+  return text;
+}
+
+}  // namespace
+
+/**
+ * @test This test checks that fixed notation matches snprintf, including
+ *       at rounding boundaries and for negative zero.
+ */
+TEST(SpaceTimeStackTest, jsonBufferFixed) {
+  for (const double value : values) {
+    for (int precision = 0; precision <= 6; ++precision) {
+      EXPECT_EQ(written([&](JsonBuffer& out) { out.fixed(value, precision); }),
+                printed("%.*f", precision, value))
+          << "value " << value << " precision " << precision;
+    }
+  }
+}
+
+/**
+ * @test This test checks that scientific notation matches snprintf,
+ *       including at rounding boundaries and for negative zero.
+ */
+TEST(SpaceTimeStackTest, jsonBufferScientific) {
+  for (const double value : values) {
+    for (int precision = 0; precision <= 6; ++precision) {
+      EXPECT_EQ(
+          written([&](JsonBuffer& out) { out.scientific(value, precision); }),
+          printed("%.*e", precision, value))
+          << "value " << value << " precision " << precision;
+    }
+  }
+}
+
+/**
+ * @test This test checks that strings are quoted, and that quotes,
+ *       backslashes and control characters are escaped.
+ */
+TEST(SpaceTimeStackTest, jsonBufferString) {
+  EXPECT_EQ(written([](JsonBuffer& out) { out.string("plain name"); }),
+            "\"plain name\"");
+  EXPECT_EQ(written([](JsonBuffer& out) { out.string("say \"hi\""); }),
+            "\"say \\\"hi\\\"\"");
+  EXPECT_EQ(written([](JsonBuffer& out) { out.string("a\\b"); }),
+            "\"a\\\\b\"");
+  EXPECT_EQ(written([](JsonBuffer& out) { out.string("1\n2\t3"); }),
+            "\"1\\n2\\t3\"");
+  EXPECT_EQ(written([](JsonBuffer& out) {
+              out.string(std::string_view("\x01\x1f\r\0", 4));
+            }),
+            "\"\\u0001\\u001f\\u000d\\u0000\"");
+}
+
+/**
+ * @test This test checks the expansion of %r, %p, %n and %% in output
+ *       paths, and that other percent signs are kept.
+ */
+TEST(SpaceTimeStackTest, expandOutputPath) {
+  const std::string pid = std::to_string(getpid());
+  EXPECT_EQ(expand_output_path("out.json", 3), "out.json");
+  EXPECT_EQ(expand_output_path("out.%r.json", 3), "out.3.json");
+  EXPECT_EQ(expand_output_path("out.%p.json", 3), "out." + pid + ".json");
+  EXPECT_EQ(expand_output_path("snap.%r.%n", 12, 7), "snap.12.7");
+  EXPECT_EQ(expand_output_path("100%%.%r", 0), "100%.0");
+  EXPECT_EQ(expand_output_path("%%r", 5), "%r");
+  EXPECT_EQ(expand_output_path("a%x%", 5), "a%x%");
+}
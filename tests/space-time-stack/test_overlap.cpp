@@ -0,0 +1,78 @@
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "Kokkos_Core.hpp"
+
+namespace {
+
+void wait() { std::this_thread::sleep_for(std::chrono::milliseconds(20)); }
+
+}  // namespace
+
+/**
+ * @test This test checks that kernels that end in another order than they
+ *       began overlap, and that a fence issued while a kernel runs is
+ *       nested in it rather than taken for a kernel running beside it.
+ */
+TEST(SpaceTimeStackTest, overlap) {
+  //! Initialize @c Kokkos.
+  Kokkos::initialize();
+
+  //! Redirect output for later analysis.
+  std::cout.flush();
+  std::ostringstream output;
+  std::streambuf* coutbuf = std::cout.rdbuf(output.rdbuf());
+
+  //! Two kernels that run at the same time and end out of order.
+  Kokkos::Tools::pushRegion("overlapping");
+  uint64_t first, second;
+  Kokkos::Tools::beginParallelFor("first kernel", 0, &first);
+  Kokkos::Tools::beginParallelFor("second kernel", 0, &second);
+  wait();
+  Kokkos::Tools::endParallelFor(first);
+  Kokkos::Tools::endParallelFor(second);
+  Kokkos::Tools::popRegion();
+
+  //! A reduction that fences while it runs.
+  Kokkos::Tools::pushRegion("fenced");
+  uint64_t reduce, fence;
+  Kokkos::Tools::beginParallelReduce("reduce kernel", 0, &reduce);
+  Kokkos::Tools::beginFence("nested fence", 0, &fence);
+  wait();
+  Kokkos::Tools::endFence(fence);
+  Kokkos::Tools::endParallelReduce(reduce);
+  Kokkos::Tools::popRegion();
+
+  //! Finalize @c Kokkos.
+  Kokkos::finalize();
+
+  //! Restore output buffer.
+  std::cout.flush();
+  std::cout.rdbuf(coutbuf);
+  std::cout << output.str() << std::endl;
+
+  //! Analyze test output. The regions may be printed in any order.
+  //! The kernels both count, and the region reports them as overlapped.
+  EXPECT_THAT(output.str(),
+              ::testing::ContainsRegex(
+                  "[| ]   \\|-> [^\n]* 1 first kernel \\[for\\]"));
+  EXPECT_THAT(output.str(),
+              ::testing::ContainsRegex(
+                  "[| ]   \\|-> [^\n]* 1 second kernel \\[for\\]"));
+  EXPECT_THAT(output.str(),
+              ::testing::ContainsRegex("\n\\|-> [^\n]* [0-9.]+% [1-9][0-9.]*% "
+                                       "[0-9.e+]+ 1 overlapping \\[region\\]"));
+  //! The fence is below the kernel, and the region overlaps nothing.
+  EXPECT_THAT(output.str(),
+              ::testing::ContainsRegex(
+                  "[| ]   \\|-> [^\n]* 1 reduce kernel \\[reduce\\]\n"
+                  "[| ]       \\|-> [^\n]* 1 nested fence \\[fence\\]"));
+  EXPECT_THAT(output.str(),
+              ::testing::ContainsRegex("\n\\|-> [^\n]* [0-9.]+% 0.0% "
+                                       "[0-9.e+]+ 1 fenced \\[region\\]"));
+}
@@ -0,0 +1,103 @@
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "Kokkos_Core.hpp"
+
+namespace {
+
+constexpr int nthreads         = 4;
+constexpr std::size_t mebibyte = 1024 * 1024;
+
+//! Run @p work on @ref nthreads host threads inside a region each.
+template <typename Work>
+void run_threads(Work work) {
+  std::vector<std::thread> threads;
+  for (int i = 0; i < nthreads; ++i) {
+    threads.emplace_back([=] {
+      Kokkos::Profiling::pushRegion("thread work");
+      work(i);
+      Kokkos::Profiling::popRegion();
+    });
+  }
+  for (auto& thread : threads) thread.join();
+}
+
+}  // namespace
+
+/**
+ * @test This test checks that regions and allocations made by concurrent
+ *       host threads are all reported, and that the high water mark is the
+ *       one of the allocations of all threads, even when a buffer is freed
+ *       by another thread than the one that allocated it.
+ *
+ * It runs twice, with the threads summed into one tree and with
+ * @c KOKKOS_PROFILE_THREAD_ROOTS set.
+ */
+TEST(SpaceTimeStackTest, threads) {
+  const bool thread_roots = std::getenv("KOKKOS_PROFILE_THREAD_ROOTS");
+
+  //! Initialize @c Kokkos.
+  Kokkos::initialize();
+
+  //! Redirect output for later analysis.
+  std::cout.flush();
+  std::ostringstream output;
+  std::streambuf* coutbuf = std::cout.rdbuf(output.rdbuf());
+
+  //! Each thread allocates a buffer, and the main thread frees them all.
+  const auto host = Kokkos::Profiling::make_space_handle("Host");
+  std::vector<char> buffers[nthreads];
+  run_threads([&](const int i) {
+    buffers[i].resize(1);
+    Kokkos::Profiling::allocateData(host, "buffer " + std::to_string(i),
+                                    buffers[i].data(), mebibyte);
+  });
+  for (int i = 0; i < nthreads; ++i) {
+    Kokkos::Profiling::deallocateData(host, "buffer " + std::to_string(i),
+                                      buffers[i].data(), mebibyte);
+  }
+
+  //! Smaller allocations, which are not at the high water mark.
+  run_threads([&](const int i) {
+    Kokkos::Profiling::allocateData(host, "scratch", buffers[i].data(), 1024);
+    Kokkos::Profiling::deallocateData(host, "scratch", buffers[i].data(),
+                                      1024);
+  });
+
+  //! Finalize @c Kokkos.
+  Kokkos::finalize();
+
+  //! Restore output buffer.
+  std::cout.flush();
+  std::cout.rdbuf(coutbuf);
+  std::cout << output.str() << std::endl;
+
+  //! Analyze test output.
+  if (thread_roots) {
+    //! Each thread is a region of its own, which ran the work once.
+    EXPECT_THAT(output.str(),
+                ::testing::ContainsRegex(" 1 thread [0-9]+ \\[region\\]"));
+    EXPECT_THAT(output.str(),
+                ::testing::ContainsRegex(" 1 thread work \\[region\\]"));
+  } else {
+    EXPECT_THAT(output.str(),
+                ::testing::ContainsRegex(" 8 thread work \\[region\\]"));
+    EXPECT_THAT(output.str(), ::testing::Not(::testing::ContainsRegex(
+                                  "thread [0-9]+ \\[region\\]")));
+  }
+  EXPECT_THAT(output.str(),
+              ::testing::HasSubstr("MAX MEMORY ALLOCATED: 4096.0 kB"));
+  for (int i = 0; i < nthreads; ++i) {
+    EXPECT_THAT(output.str(),
+                ::testing::HasSubstr("  25.0% thread work/buffer " +
+                                     std::to_string(i) + "\n"));
+  }
+  EXPECT_THAT(output.str(), ::testing::Not(::testing::HasSubstr("scratch")));
+}